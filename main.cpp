@@ -1,15 +1,60 @@
 #include "sudoku.h"
+#include "sudoku_batch.h"
+#include "sudoku_binary.h"
+#include "sudoku_cache.h"
+#include "sudoku_bench.h"
+#include "sudoku_metrics.h"
+#include "sudoku_schedule.h"
+#include "sudoku_stream.h"
 #include "sudoku_test.h"
+#include "sudoku_trace.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 
 using namespace std;
 
-int main()
+static void PrintUsage()
 {
-    SudokuTest::TestSudoku();
+    cerr << "Usage: sudoku [--test] [--example] [--threads N] [--cache N | --rate]"s << endl
+         << "              [--adaptive | --schedule F] [--metrics F [--metrics-period S]]"s << endl
+         << "              [--trace F [--trace-sample N]] [FILE...]"s << endl
+         << "       sudoku --bench [--repeat N] [FILE...]"s << endl
+         << "       sudoku --microbench [--ops N]"s << endl
+         << "       sudoku --pack OUT [FILE...] | --unpack [FILE...]"s << endl
+         << "Solves puzzles given one per line as 81 characters ('.' or '0' for blanks)"s << endl
+         << "and writes the solutions to stdout in input order."s << endl
+         << "Reads stdin when FILE is '-' or no file is given, packed FILEs are detected."s << endl
+         << "  --test       run the self-test"s << endl
+         << "  --example    solve the built-in example and print the steps"s << endl
+         << "  --threads N  number of solver threads (default: all cores)"s << endl
+         << "  --cache N    reuse solutions of up to N puzzles, also when relabelled or permuted"s << endl
+         << "  --rate       append the difficulty score and tier to every solution"s << endl
+         << "  --adaptive   experimental: order the techniques by their measured cost per"s << endl
+         << "               placement, no measured gain so far"s << endl
+         << "  --schedule F --adaptive, starting from the costs saved in F and saving them back"s << endl
+         << "  --metrics F  write solver metrics to F, as JSON when F ends in .json, else"s << endl
+         << "               in the Prometheus text format"s << endl
+         << "  --metrics-period S  seconds between two metrics snapshots (default: 10)"s << endl
+         << "  --trace F    write a Chrome trace of the solver passes to F at exit"s << endl
+         << "  --trace-sample N  trace one solve in N per thread (default: 1)"s << endl
+         << "  --bench      benchmark the embedded datasets and FILEs, print JSON"s << endl
+         << "  --repeat N   solves of every puzzle in the benchmark (default: 100)"s << endl
+         << "  --microbench benchmark the solver kernels on captured states, print JSON"s << endl
+         << "  --ops N      calls of every kernel in the micro-benchmark (default: 200000)"s << endl
+         << "  --pack OUT   convert the text FILEs to a packed binary file"s << endl
+         << "  --unpack     write the puzzles of the packed FILEs as text"s << endl;
+}
 
+static void SolveExample()
+{
     vector<int> example = {
         3, 0, 5,  6, 7, 0,  0, 0, 8,
         0, 0, 8,  0, 9, 0,  2, 0, 1,
@@ -29,6 +74,274 @@ int main()
     SudokuResult res = solver.Solve();
 
     cout << endl << res << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    bool run_test = false;
+    bool run_example = false;
+    bool run_bench = false;
+    bool run_microbench = false;
+    size_t repeat = 100;
+    size_t ops = 200000;
+    size_t thread_count = thread::hardware_concurrency();
+    size_t cache_size = 0;
+    bool run_rate = false;
+    bool run_adaptive = false;
+    string schedule_path;
+    string metrics_path;
+    size_t metrics_period = 10;
+    string trace_path;
+    size_t trace_sample = 1;
+    string pack_path;
+    bool run_unpack = false;
+    vector<string> files;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const string arg = argv[i];
+        if (arg == "--test"s)
+        {
+            run_test = true;
+        }
+        else if (arg == "--example"s)
+        {
+            run_example = true;
+        }
+        else if (arg == "--bench"s)
+        {
+            run_bench = true;
+        }
+        else if (arg == "--microbench"s)
+        {
+            run_microbench = true;
+        }
+        else if (arg == "--ops"s && i + 1 < argc)
+        {
+            ops = static_cast<size_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--repeat"s && i + 1 < argc)
+        {
+            repeat = static_cast<size_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--threads"s && i + 1 < argc)
+        {
+            thread_count = static_cast<size_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--cache"s && i + 1 < argc)
+        {
+            cache_size = static_cast<size_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--rate"s)
+        {
+            run_rate = true;
+        }
+        else if (arg == "--adaptive"s)
+        {
+            run_adaptive = true;
+        }
+        else if (arg == "--schedule"s && i + 1 < argc)
+        {
+            run_adaptive = true;
+            schedule_path = argv[++i];
+        }
+        else if (arg == "--metrics"s && i + 1 < argc)
+        {
+            metrics_path = argv[++i];
+        }
+        else if (arg == "--metrics-period"s && i + 1 < argc)
+        {
+            metrics_period = static_cast<size_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--trace"s && i + 1 < argc)
+        {
+            trace_path = argv[++i];
+        }
+        else if (arg == "--trace-sample"s && i + 1 < argc)
+        {
+            trace_sample = static_cast<size_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--pack"s && i + 1 < argc)
+        {
+            pack_path = argv[++i];
+        }
+        else if (arg == "--unpack"s)
+        {
+            run_unpack = true;
+        }
+        else if (arg == "--help"s || arg == "-h"s)
+        {
+            PrintUsage();
+            return 0;
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            PrintUsage();
+            return 2;
+        }
+        else
+        {
+            files.push_back(arg);
+        }
+    }
+
+    if (run_microbench)
+    {
+        vector<vector<int>> puzzles;
+        for (const auto* data : { &SudokuTest::DataEasy(), &SudokuTest::DataMedium(), &SudokuTest::DataHard(),
+                 &SudokuTest::DataExtream() })
+        {
+            for (const auto& [input, solved] : *data)
+            {
+                puzzles.push_back(input);
+            }
+        }
+        SudokuMicroBench microbench(ops);
+        microbench.CaptureStates(puzzles);
+        microbench.Run(cout);
+        return 0;
+    }
+
+    if (run_bench)
+    {
+        SudokuBench bench(repeat);
+        bench.AddEmbeddedDatasets();
+        try
+        {
+            for (const string& file : files)
+            {
+                bench.AddFile(file);
+            }
+        }
+        catch (const exception& e)
+        {
+            cerr << e.what() << endl;
+            return 2;
+        }
+        bench.Run(cout);
+        return 0;
+    }
+
+    if (run_test)
+    {
+        SudokuTest::TestSudoku();
+    }
+    if (run_example)
+    {
+        SolveExample();
+    }
+    if ((run_test || run_example) && files.empty())
+    {
+        return 0;
+    }
+    if (files.empty())
+    {
+        files.push_back("-"s);
+    }
+
+    ios::sync_with_stdio(false);
+    if (!pack_path.empty() || run_unpack)
+    {
+        size_t skipped = 0;
+        try
+        {
+            if (!pack_path.empty())
+            {
+                SudokuBinaryWriter writer(pack_path, false);
+                for (const string& file : files)
+                {
+                    SudokuLineReader reader(file);
+                    skipped += ConvertTextToBinary(reader, writer);
+                }
+                writer.Close();
+            }
+            else
+            {
+                for (const string& file : files)
+                {
+                    ConvertBinaryToText(SudokuBinaryFile(file), cout);
+                }
+                cout.flush();
+            }
+        }
+        catch (const exception& e)
+        {
+            cerr << e.what() << endl;
+            return 2;
+        }
+        return skipped == 0 ? 0 : 1;
+    }
+
+    SudokuBatchSolver batch(thread_count);
+    unique_ptr<SudokuSolutionCache> cache;
+    // cache hits carry no solution steps to rate
+    if (cache_size > 0 && !run_rate)
+    {
+        cache = make_unique<SudokuSolutionCache>(cache_size);
+        batch.SetCache(cache.get());
+    }
+    unique_ptr<SudokuAdaptiveStrategy> strategy;
+    // the ratings follow the fixed order, not what this workload taught
+    if (run_adaptive && !run_rate)
+    {
+        strategy = make_unique<SudokuAdaptiveStrategy>();
+        batch.SetStrategy(strategy.get());
+    }
+    unique_ptr<SudokuMetrics> metrics;
+    unique_ptr<SudokuMetricsExporter> exporter;
+    if (!metrics_path.empty())
+    {
+        metrics = make_unique<SudokuMetrics>();
+        metrics->SetCache(cache.get());
+        batch.SetMetrics(metrics.get());
+        const bool json = metrics_path.size() >= 5 && metrics_path.compare(metrics_path.size() - 5, 5, ".json"s) == 0;
+        exporter = make_unique<SudokuMetricsExporter>(*metrics, metrics_path,
+            json ? SudokuMetricsFormat::Json : SudokuMetricsFormat::Prometheus,
+            chrono::seconds(max<size_t>(metrics_period, 1)));
+    }
+    unique_ptr<SudokuTracer> tracer;
+    if (!trace_path.empty())
+    {
+        tracer = make_unique<SudokuTracer>(trace_sample);
+        batch.SetTracer(tracer.get());
+    }
+    SudokuStreamSolver stream(batch);
+    stream.SetRating(run_rate);
+    size_t failed = 0;
+    try
+    {
+        if (strategy && !schedule_path.empty())
+        {
+            strategy->Load(schedule_path);
+        }
+        for (const string& file : files)
+        {
+            if (SudokuBinaryFile::IsBinary(file))
+            {
+                failed += stream.Run(SudokuBinaryFile(file), cout).failed;
+                continue;
+            }
+            SudokuLineReader reader(file);
+            failed += stream.Run(reader, cout).failed;
+        }
+        if (strategy && !schedule_path.empty())
+        {
+            strategy->Save(schedule_path);
+        }
+        if (exporter)
+        {
+            exporter->Stop();
+        }
+        if (tracer)
+        {
+            tracer->Save(trace_path);
+        }
+    }
+    catch (const exception& e)
+    {
+        cerr << e.what() << endl;
+        return 2;
+    }
 
-    return 0;
+    return failed == 0 ? 0 : 1;
 }
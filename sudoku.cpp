@@ -1,32 +1,177 @@
 #include "sudoku.h"
 
+#include "sudoku_metrics.h"
+#include "sudoku_trace.h"
+
 #include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <functional>
+#include <iterator>
 #include <stdexcept>
 #include <string>
 
+#if defined(__SSE2__)
+#define SUDOKU_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
 using namespace std::string_literals;
 
-SudokuValid operator+(const SudokuValid& lhs, const SudokuValid& rhs)
+const char* ErrorName(SudokuError error)
 {
-    SudokuValid valid;
-    valid.is_valid = lhs.is_valid && rhs.is_valid;
-    if (!lhs)
+    switch (error)
     {
-        valid.text += lhs.text;
+    case SudokuError::None:
+        return "none";
+    case SudokuError::Duplicate:
+        return "duplicate";
+    case SudokuError::BadValue:
+        return "bad_value";
+    case SudokuError::NoSolution:
+        return "no_solution";
+    case SudokuError::WrongSize:
+        return "wrong_size";
+    case SudokuError::BadCharacter:
+        return "bad_character";
+    default:
+        return "unknown";
     }
-    if (!rhs)
+}
+
+SudokuValid operator+(const SudokuValid& lhs, const SudokuValid& rhs)
+{
+    return !lhs ? lhs : rhs;
+}
+
+std::string SudokuValid::Text() const
+{
+    switch (error)
     {
-        if (!lhs) {
-            valid.text += "\n"s;
+    case SudokuError::None:
+        return ""s;
+    case SudokuError::Duplicate:
+        if (unit == SudokuUnit::Square)
+        {
+            return "Number "s + std::to_string(number) + " has appeared in the square "s +
+                SudokuGrid::Squares()[index].Str() + " at least twice"s;
         }
-        valid.text += rhs.text;
+        return "Number "s + std::to_string(number) + " has appeared in the "s +
+            (unit == SudokuUnit::Row ? "row "s : "col "s) + std::to_string(index) + " at least twice"s;
+    case SudokuError::BadValue:
+        return "Invalid number "s + std::to_string(number) + " in row "s + std::to_string(index / 9) + " col "s +
+            std::to_string(index % 9);
+    case SudokuError::NoSolution:
+        return "Sudoku has no solution"s;
+    case SudokuError::WrongSize:
+        return "Expected 81 cells"s;
+    case SudokuError::BadCharacter:
+        return "Invalid character '"s + static_cast<char>(number) + "' in row "s + std::to_string(index / 9) +
+            " col "s + std::to_string(index % 9);
+    default:
+        return "Unknown error"s;
     }
-    return valid;
+}
+
+std::ostream& operator<<(std::ostream& out, const SudokuValid& valid)
+{
+    return out << valid.Text();
 }
 
 // ----------------------------------------------------------------------------
 
+std::string SudokuStep::Str() const
+{
+    return "Put number "s + std::to_string(number) + " in row "s + std::to_string(Row()) + " col "s +
+        std::to_string(Col()) + " ("s + TechniqueName(Technique()) + ", pass "s + std::to_string(pass) + ")"s;
+}
+
+std::ostream& operator<<(std::ostream& out, const SudokuStep& step)
+{
+    out << "Put number "s << static_cast<int>(step.number) << " in row "s << step.Row() << " col "s << step.Col()
+        << " ("s << TechniqueName(step.Technique()) << ", pass "s << static_cast<int>(step.pass) << ")"s;
+    return out;
+}
+
+// ----------------------------------------------------------------------------
+
+const char* TechniqueName(SudokuTechnique technique)
+{
+    switch (technique)
+    {
+    case SudokuTechnique::CrossingOut:
+        return "crossing_out";
+    case SudokuTechnique::HiddenSingle:
+        return "hidden_single";
+    case SudokuTechnique::NakedSingle:
+        return "naked_single";
+    case SudokuTechnique::DoubleGuess:
+        return "double_guess";
+    case SudokuTechnique::TripleGuess:
+        return "triple_guess";
+    case SudokuTechnique::Pointing:
+        return "pointing";
+    case SudokuTechnique::BoxLine:
+        return "box_line";
+    case SudokuTechnique::NakedSubset:
+        return "naked_subset";
+    case SudokuTechnique::HiddenSubset:
+        return "hidden_subset";
+    case SudokuTechnique::Fish:
+        return "fish";
+    case SudokuTechnique::Coloring:
+        return "coloring";
+    case SudokuTechnique::Search:
+        return "search";
+    default:
+        return "unknown";
+    }
+}
+
+const char* StageName(SudokuStage stage)
+{
+    switch (stage)
+    {
+    case SudokuStage::DoubleGuess:
+        return "double_guess";
+    case SudokuStage::TripleGuess:
+        return "triple_guess";
+    case SudokuStage::Candidates:
+        return "candidates";
+    default:
+        return "unknown";
+    }
+}
+
+std::ostream& operator<<(std::ostream& out, const SudokuStats& stats)
+{
+    out << "passes "s << stats.passes << ", cells examined "s << stats.cells_examined << ", search nodes "s
+        << stats.search_nodes << ", backtracks "s << stats.search_backtracks << std::endl;
+    for (size_t technique = 0; technique < stats.calls.size(); ++technique)
+    {
+        if (stats.calls[technique] != 0)
+        {
+            out << TechniqueName(static_cast<SudokuTechnique>(technique)) << ": "s << stats.hits[technique] << " of "s
+                << stats.calls[technique] << std::endl;
+        }
+    }
+    out << "setup "s << stats.setup_ns << " ns, singles "s << stats.singles_ns << " ns"s;
+    for (size_t stage = 0; stage < stats.stage_ns.size(); ++stage)
+    {
+        out << ", "s << StageName(static_cast<SudokuStage>(stage)) << " "s << stats.stage_ns[stage] << " ns"s;
+    }
+    out << ", search "s << stats.search_ns << " ns"s << std::endl;
+    return out;
+}
+
+void SudokuResult::Clear()
+{
+    valid = SudokuValid();
+    solution_steps.clear();
+    techniques = 0;
+    SUDOKU_STAT(stats = SudokuStats());
+}
+
 void SudokuResult::Print() const
 {
     for (size_t i = 0; i < solution_steps.size(); ++i)
@@ -40,7 +185,7 @@ std::ostream& operator<<(std::ostream& out, const SudokuResult& result)
     if (!result.valid)
     {
         std::cout << "Errors:"s << std::endl;
-        std::cout << result.valid.text << std::endl;
+        std::cout << result.valid << std::endl;
     }
     else
     {
@@ -48,6 +193,9 @@ std::ostream& operator<<(std::ostream& out, const SudokuResult& result)
         result.Print();
         std::cout << std::endl;
     }
+#ifdef SUDOKU_STATS
+    std::cout << result.stats << std::endl;
+#endif
     return out;
 }
 
@@ -64,58 +212,136 @@ std::string SudokuSquare::Str() const
 SudokuGrid::SudokuGrid(const std::vector<int>& values)
 {
     FillGrid(values);
-    CreateSquares();
 }
 
-int& SudokuGrid::operator()(int row, int col)
+uint8_t& SudokuGrid::operator()(int row, int col)
 {
     return m_sudoku[Index(row, col)];
 }
 
-const int& SudokuGrid::operator()(int row, int col) const
+int SudokuGrid::operator()(int row, int col) const
 {
-    return m_sudoku.at(Index(row, col));
+    return m_sudoku[Index(row, col)];
 }
 
 void SudokuGrid::FillGrid(const std::vector<int>& values)
 {
-    if (values.size() != 81)
+    const SudokuValid valid = TryFillGrid(values);
+    if (valid.error == SudokuError::WrongSize)
     {
         throw std::invalid_argument("Input vector size must be 81"s);
     }
-    for (int v : values) {
-        if (v < 0 || v > 9) {
-            throw std::invalid_argument("Can't fill the grid. Invalid number " + std::to_string(v));
+    if (!valid)
+    {
+        throw std::invalid_argument("Can't fill the grid. Invalid number " + std::to_string(values[valid.index]));
+    }
+}
+
+SudokuValid SudokuGrid::TryFillGrid(const std::vector<int>& values)
+{
+    if (values.size() != 81)
+    {
+        return SudokuValid::Error(SudokuError::WrongSize);
+    }
+    for (int i = 0; i < 81; ++i)
+    {
+        if (values[i] < 0 || values[i] > 9)
+        {
+            return SudokuValid::Error(SudokuError::BadValue, SudokuUnit::Cell, i, values[i]);
         }
-        m_sudoku.push_back(v);
     }
+    std::copy(values.begin(), values.end(), m_sudoku.begin());
+    return SudokuValid();
 }
 
-std::vector<int> SudokuGrid::Neighbours(int row_col) const
+SudokuValid SudokuGrid::TryFillGrid(const uint8_t* values, size_t size)
 {
-    if (row_col < 0 || row_col > 2) {
-        throw std::invalid_argument("Can't find a neighbour. Invalid row or col value " + std::to_string(row_col));
+    if (size != 81)
+    {
+        return SudokuValid::Error(SudokuError::WrongSize);
+    }
+    for (int i = 0; i < 81; ++i)
+    {
+        if (values[i] > 9)
+        {
+            return SudokuValid::Error(SudokuError::BadValue, SudokuUnit::Cell, i, values[i]);
+        }
     }
-    std::vector<int> rows_cols = { 0, 1, 2 };
-    rows_cols.erase(std::find(rows_cols.begin(), rows_cols.end(), row_col));
-    return rows_cols;
+    std::memcpy(m_sudoku.data(), values, 81);
+    return SudokuValid();
 }
 
-int SudokuGrid::Index(int row, int col) const
+#ifdef SUDOKU_HAS_SSE2
+namespace
 {
-    IsRowColValid(row, col);
-    return row * 9 + col;
+// Converts 16 characters to numbers, returns a bit per character that is
+// neither '.' nor a digit
+unsigned ParseBlock(const char* line, uint8_t* cells)
+{
+    const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line));
+    const __m128i dots = _mm_cmpeq_epi8(chars, _mm_set1_epi8('.'));
+    const __m128i digits = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    const __m128i in_range = _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(cells), _mm_andnot_si128(dots, digits));
+    return ~static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(dots, in_range))) & 0xFFFFu;
+}
 }
+#endif
 
-void SudokuGrid::CreateSquares()
+SudokuValid SudokuGrid::TryFillGrid(std::string_view line)
 {
-    for (int row = 0, local_row = 0; row < 9; row = row + 3, ++local_row)
+    if (line.size() != 81)
     {
-        for (int col = 0, local_col = 0; col < 9; col = col + 3, ++local_col)
+        return SudokuValid::Error(SudokuError::WrongSize);
+    }
+    std::array<uint8_t, 81> cells;
+#ifdef SUDOKU_HAS_SSE2
+    // the last block overlaps the previous one to cover the 81st character
+    for (size_t offset : { 0, 16, 32, 48, 64, 65 })
+    {
+        const unsigned bad = ParseBlock(line.data() + offset, cells.data() + offset);
+        if (bad != 0)
+        {
+            const int index = static_cast<int>(offset) + LowestBit(bad);
+            return SudokuValid::Error(SudokuError::BadCharacter, SudokuUnit::Cell, index,
+                static_cast<uint8_t>(line[index]));
+        }
+    }
+#else
+    for (int i = 0; i < 81; ++i)
+    {
+        const char c = line[i];
+        if (c == '.')
+        {
+            cells[i] = 0;
+        }
+        else if (c >= '0' && c <= '9')
         {
-            m_squares.push_back({ row, row + 3, col, col + 3, local_row, local_col });
+            cells[i] = static_cast<uint8_t>(c - '0');
         }
+        else
+        {
+            return SudokuValid::Error(SudokuError::BadCharacter, SudokuUnit::Cell, i, static_cast<uint8_t>(c));
+        }
+    }
+#endif
+    m_sudoku = cells;
+    return SudokuValid();
+}
+
+const std::array<int, 2>& SudokuGrid::Neighbours(int row_col) const
+{
+    static const std::array<std::array<int, 2>, 3> neighbours = { { { 1, 2 }, { 0, 2 }, { 0, 1 } } };
+    if (row_col < 0 || row_col > 2) {
+        throw std::invalid_argument("Can't find a neighbour. Invalid row or col value " + std::to_string(row_col));
     }
+    return neighbours[row_col];
+}
+
+int SudokuGrid::Index(int row, int col) const
+{
+    IsRowColValid(row, col);
+    return row * 9 + col;
 }
 
 void SudokuGrid::IsRowColValid(int row, int col) const
@@ -157,7 +383,7 @@ std::ostream& operator<<(std::ostream& out, const SudokuGrid& grid)
             {
                 out << "|"s;
             }
-            out << " "s << grid(row, col) << " "s;
+            out << " "s << grid.Cell(row, col) << " "s;
         }
         out << "|"s << std::endl;
     }
@@ -169,10 +395,16 @@ std::ostream& operator<<(std::ostream& out, const SudokuGrid& grid)
 
 SudokuValid SudokuCheckValidity::IsSudokuValid(const SudokuGrid& grid)
 {
-    SudokuValid rows_valid = IsRowsValid(grid);
-    SudokuValid cols_valid = IsColsValid(grid);
-    SudokuValid squares_valid = IsSquaresValid(grid);
-    return rows_valid + cols_valid + squares_valid;
+    SudokuValid valid = IsRowsValid(grid);
+    if (valid)
+    {
+        valid = IsColsValid(grid);
+    }
+    if (valid)
+    {
+        valid = IsSquaresValid(grid);
+    }
+    return valid;
 }
 
 SudokuValid SudokuCheckValidity::IsRowsValid(const SudokuGrid& grid)
@@ -219,513 +451,1530 @@ SudokuValid SudokuCheckValidity::IsSquaresValid(const SudokuGrid& grid)
 
 SudokuValid SudokuCheckValidity::IsRowValid(const SudokuGrid& grid, int row)
 {
-    int col_values[9];
-    std::fill_n(std::begin(col_values), 9, 0);
+    unsigned seen = 0;
     for (int col = 0; col < 9; ++col)
     {
-        int value = grid(row, col);
+        int value = grid.Cell(row, col);
         if (value == 0)
         {
             continue;
         }
-        int index = value - 1;
-        if (col_values[index] > 0)
+        const unsigned bit = 1u << value;
+        if ((seen & bit) != 0)
         {
-            return { false, "Number "s + std::to_string(value) + " has appeared in the row "s + std::to_string(row) +
-                            " at least twice"s };
+            return SudokuValid::Error(SudokuError::Duplicate, SudokuUnit::Row, row, value);
         }
-        col_values[index] = value;
+        seen |= bit;
     }
-    return { true, ""s };
+    return SudokuValid();
 }
 
 SudokuValid SudokuCheckValidity::IsColValid(const SudokuGrid& grid, int col)
 {
-    int row_values[9];
-    std::fill_n(std::begin(row_values), 9, 0);
+    unsigned seen = 0;
     for (int row = 0; row < 9; ++row)
     {
-        int value = grid(row, col);
+        int value = grid.Cell(row, col);
         if (value == 0)
         {
             continue;
         }
-        int index = value - 1;
-        if (row_values[index] > 0)
+        const unsigned bit = 1u << value;
+        if ((seen & bit) != 0)
         {
-            return { false, "Number "s + std::to_string(value) + " has appeared in the col "s + std::to_string(col) +
-                            " at least twice"s };
+            return SudokuValid::Error(SudokuError::Duplicate, SudokuUnit::Col, col, value);
         }
-        row_values[index] = value;
+        seen |= bit;
     }
-    return { true, ""s };
+    return SudokuValid();
 }
 
 SudokuValid SudokuCheckValidity::IsSquareValid(const SudokuGrid& grid, const SudokuSquare& square)
 {
-    int square_values[9];
-    std::fill_n(std::begin(square_values), 9, 0);
+    unsigned seen = 0;
     for (int row = square.row_begin; row < square.row_end; ++row)
     {
         for (int col = square.col_begin; col < square.col_end; ++col)
         {
-            int value = grid(row, col);
+            int value = grid.Cell(row, col);
             if (value == 0)
             {
                 continue;
             }
-            int index = value - 1;
-            if (square_values[index] > 0)
+            const unsigned bit = 1u << value;
+            if ((seen & bit) != 0)
             {
-                return { false, "Number "s + std::to_string(value) + " has appeared in the square "s + square.Str() +
-                                " at least twice"s };
+                return SudokuValid::Error(SudokuError::Duplicate, SudokuUnit::Square, square.row * 3 + square.col,
+                    value);
             }
-            square_values[index] = value;
+            seen |= bit;
         }
     }
-    return { true, ""s };
+    return SudokuValid();
 }
 
 // ----------------------------------------------------------------------------
 
+Sudoku::Sudoku()
+{
+    CreateMasks();
+}
+
 Sudoku::Sudoku(const std::vector<int>& values)
     : SudokuGrid(values)
 {
+    CreateMasks();
+}
 
+Sudoku::Sudoku(const SudokuGrid& grid)
+    : SudokuGrid(grid)
+{
+    CreateMasks();
 }
 
-SudokuValid Sudoku::IsSudokuValid() const
+void Sudoku::FillGrid(const std::vector<int>& values)
 {
-    return SudokuCheckValidity::IsSudokuValid(*this);
+    SudokuGrid::FillGrid(values);
+    CreateMasks();
 }
 
-bool Sudoku::HasRowNumber(int row, int number) const
+SudokuValid Sudoku::TryFillGrid(const std::vector<int>& values)
 {
-    for (int col = 0; col < 9; ++col)
+    const SudokuValid valid = SudokuGrid::TryFillGrid(values);
+    if (valid)
     {
-        if ((*this)(row, col) == number)
-        {
-            return true;
-        }
+        CreateMasks();
     }
-    return false;
+    return valid;
 }
 
-bool Sudoku::HasColNumber(int col, int number) const
+SudokuValid Sudoku::TryFillGrid(const uint8_t* values, size_t size)
 {
-    for (int row = 0; row < 9; ++row)
+    const SudokuValid valid = SudokuGrid::TryFillGrid(values, size);
+    if (valid)
     {
-        if ((*this)(row, col) == number)
-        {
-            return true;
-        }
+        CreateMasks();
     }
-    return false;
+    return valid;
 }
 
-bool Sudoku::HasSquareNumber(const SudokuSquare& square, int number) const
+SudokuValid Sudoku::TryFillGrid(std::string_view line)
 {
-    for (int row = square.row_begin; row < square.row_end; ++row)
+    const SudokuValid valid = SudokuGrid::TryFillGrid(line);
+    if (valid)
     {
-        for (int col = square.col_begin; col < square.col_end; ++col)
-        {
-            if ((*this)(row, col) == number)
-            {
-                return true;
-            }
-        }
+        CreateMasks();
     }
-    return false;
+    return valid;
+}
+
+void Sudoku::PutNumber(int row, int col, int number)
+{
+    if (number < 0 || number > 9)
+    {
+        throw std::invalid_argument("Can't put number. Invalid number " + std::to_string(number));
+    }
+    IsRowColValid(row, col);
+    PutNumberUnchecked(row, col, number);
+}
+
+void Sudoku::PutNumberUnchecked(int row, int col, int number)
+{
+    assert(number >= 0 && number <= 9);
+    uint8_t& cell = MutableCell(row, col);
+    const int previous = cell;
+    cell = static_cast<uint8_t>(number);
+    if (previous == 0)
+    {
+        AddToMasks(row, col, number);
+    }
+    else
+    {
+        --m_filled;
+        m_filled += number != 0;
+        RescanUnits(row, col);
+    }
+}
+
+SudokuValid Sudoku::IsSudokuValid() const
+{
+    if (IsConsistent())
+    {
+        return SudokuValid();
+    }
+    return SudokuCheckValidity::IsSudokuValid(*this);
+}
+
+bool Sudoku::HasRowNumber(int row, int number) const
+{
+    return (m_row_numbers[row] & NumberBit(number)) != 0;
+}
+
+bool Sudoku::HasColNumber(int col, int number) const
+{
+    return (m_col_numbers[col] & NumberBit(number)) != 0;
+}
+
+bool Sudoku::HasSquareNumber(const SudokuSquare& square, int number) const
+{
+    return (m_square_numbers[square.row * 3 + square.col] & NumberBit(number)) != 0;
 }
 
-std::vector<int> Sudoku::AvailableRows(int number, const SudokuSquare& square) const
+uint16_t Sudoku::AvailableRows(int number, const SudokuSquare& square) const
 {
-    std::vector<int> available_rows;
+    uint16_t available_rows = 0;
     if (HasSquareNumber(square, number)) {
         return available_rows;
     }
+    const uint16_t free_cols = SquareColsMask(square) & ~m_number_cols[number - 1];
     for (int row = square.row_begin; row < square.row_end; ++row)
     {
-        if (!HasRowNumber(row, number))
+        if (!HasRowNumber(row, number) && (m_row_empty[row] & free_cols) != 0)
         {
-            bool all_places_are_busy = true;
-            for (int col = square.col_begin; col < square.col_end; ++col)
-            {
-                if ((*this)(row, col) == 0 && !HasColNumber(col, number))
-                {
-                    all_places_are_busy = false;
-                    break;
-                }
-            }
-            if (!all_places_are_busy)
-            {
-                available_rows.push_back(row);
-            }
+            available_rows |= static_cast<uint16_t>(1u << row);
         }
     }
     return available_rows;
 }
 
-std::vector<int> Sudoku::AvailableCols(int number, const SudokuSquare& square) const
+uint16_t Sudoku::AvailableCols(int number, const SudokuSquare& square) const
 {
-    std::vector<int> available_cols;
+    uint16_t free_cells = 0;
     if (HasSquareNumber(square, number)) {
-        return available_cols;
+        return free_cells;
     }
-    for (int col = square.col_begin; col < square.col_end; ++col)
+    for (int row = square.row_begin; row < square.row_end; ++row)
     {
-        if (!HasColNumber(col, number))
+        if (!HasRowNumber(row, number))
         {
-            bool all_places_are_busy = true;
-            for (int row = square.row_begin; row < square.row_end; ++row)
-            {
-                if ((*this)(row, col) == 0 && !HasRowNumber(row, number))
-                {
-                    all_places_are_busy = false;
-                    break;
-                }
-            }
-            if (!all_places_are_busy)
-            {
-                available_cols.push_back(col);
-            }
+            free_cells |= m_row_empty[row];
         }
     }
-    return available_cols;
+    return free_cells & SquareColsMask(square) & ~m_number_cols[number - 1];
 }
 
 Sudoku::SudokuFoundPlace Sudoku::SearchUsingCrossingOut(const SudokuSquare& square, int number)
 {
     SudokuFoundPlace place = { false, 0, 0 };
+    const uint16_t free_cols = SquareColsMask(square) & ~m_number_cols[number - 1];
     for (int row = square.row_begin; row < square.row_end; ++row)
     {
         if (HasRowNumber(row, number))
         {
             continue;
         }
-        for (int col = square.col_begin; col < square.col_end; ++col)
+        const uint16_t free_cells = m_row_empty[row] & free_cols;
+        if (free_cells == 0)
         {
-            if ((*this)(row, col) == 0)
-            {
-                if (!HasColNumber(col, number))
-                {
-                    if (!place)
-                    {
-                        place = { true, row, col };
-                    }
-                    else
-                    {
-                        return { false, 0, 0 };
-                    }
-                }
-            }
+            continue;
         }
+        if (place || (free_cells & (free_cells - 1)) != 0)
+        {
+            return { false, 0, 0 };
+        }
+        place = { true, row, LowestBit(free_cells) };
     }
     return place;
 }
 
 Sudoku::SudokuFoundPlace Sudoku::SearchUsingDoubleGuess(const SudokuSquare& square, int number)
 {
-    std::vector<int> res_v;
-    const std::vector<int> col_neighbours = Neighbours(square.col);
+    const std::array<int, 2>& col_neighbours = Neighbours(square.col);
     const int start_index = square.row * 3;
-    const int first_neighbour_index = start_index + col_neighbours.at(0);
-    const int second_neighbour_index = start_index + col_neighbours.at(1);
+    const int first_neighbour_index = start_index + col_neighbours[0];
+    const int second_neighbour_index = start_index + col_neighbours[1];
 
-    std::vector<int> available_rows_0 = AvailableRows(number, square);
-    const std::vector<int> available_rows_1 = AvailableRows(number, Squares().at(first_neighbour_index));
-    const std::vector<int> available_rows_2 = AvailableRows(number, Squares().at(second_neighbour_index));
-
-    if (available_rows_1.size() == 2 && available_rows_1 == available_rows_2 && available_rows_0 != available_rows_1)
+    const uint16_t final_rows = SingleLine(AvailableRows(number, square),
+        AvailableRows(number, Squares()[first_neighbour_index]),
+        AvailableRows(number, Squares()[second_neighbour_index]));
+    if (final_rows == 0)
     {
-        std::set_difference(available_rows_0.begin(), available_rows_0.end(), available_rows_1.begin(),
-            available_rows_1.end(), std::back_inserter(res_v));
+        return { false, 0, 0 };
     }
-    else
+
+    const int final_row = LowestBit(final_rows);
+    const uint16_t free_cells = m_row_empty[final_row] & SquareColsMask(square) & ~m_number_cols[number - 1];
+    if (BitCount(free_cells) != 1)
     {
-        if (available_rows_0.size() == 2)
-        {
-            if (available_rows_1.size() == 1)
-            {
-                std::set_difference(available_rows_0.begin(), available_rows_0.end(), available_rows_1.begin(),
-                    available_rows_1.end(), std::back_inserter(res_v));
-            }
-        }
-        if (available_rows_0.size() == 2)
-        {
-            if (available_rows_2.size() == 1)
-            {
-                std::set_difference(available_rows_0.begin(), available_rows_0.end(), available_rows_2.begin(),
-                    available_rows_2.end(), std::back_inserter(res_v));
-            }
-        }
+        return { false, 0, 0 };
     }
+    return { true, final_row, LowestBit(free_cells) };
+}
+
+Sudoku::SudokuFoundPlace Sudoku::SearchUsingTripleGuess(const SudokuSquare& square, int number)
+{
+    const std::array<int, 2>& row_neighbours = Neighbours(square.row);
+    const int start_index = square.col;
+    const int first_neighbour_index = start_index + row_neighbours[0] * 3;
+    const int second_neighbour_index = start_index + row_neighbours[1] * 3;
 
-    if (res_v.size() != 1)
+    const uint16_t final_cols = SingleLine(AvailableCols(number, square),
+        AvailableCols(number, Squares()[first_neighbour_index]),
+        AvailableCols(number, Squares()[second_neighbour_index]));
+    if (final_cols == 0)
     {
         return { false, 0, 0 };
     }
 
-    int final_row = res_v.front();
-    int final_col = 0;
+    const int final_col = LowestBit(final_cols);
+    int final_row = 0;
     bool res = false;
-    for (int col = square.col_begin; col < square.col_end; ++col)
+    for (int row = square.row_begin; row < square.row_end; ++row)
     {
-        if ((*this)(final_row, col) == 0 && !HasColNumber(col, number))
+        if ((m_row_empty[row] >> final_col & 1u) != 0 && !HasRowNumber(row, number))
         {
             if (res)
             {
                 return { false, 0, 0 };
             }
-            final_col = col;
+            final_row = row;
             res = true;
         }
     }
     return { res, final_row, final_col };
 }
 
-Sudoku::SudokuFoundPlace Sudoku::SearchUsingTripleGuess(const SudokuSquare& square, int number)
+uint16_t Sudoku::SingleLine(uint16_t available_0, uint16_t available_1, uint16_t available_2)
 {
-    std::vector<int> res_v;
-    const std::vector<int> row_neighbours = Neighbours(square.row);
-    const int start_index = square.col;
-    const int first_neighbour_index = start_index + row_neighbours.at(0) * 3;
-    const int second_neighbour_index = start_index + row_neighbours.at(1) * 3;
-
-    std::vector<int> available_cols_0 = AvailableCols(number, square);
-    const std::vector<int> available_cols_1 = AvailableCols(number, Squares().at(first_neighbour_index));
-    const std::vector<int> available_cols_2 = AvailableCols(number, Squares().at(second_neighbour_index));
-
-    if (available_cols_1.size() == 2 && available_cols_1 == available_cols_2 && available_cols_0 != available_cols_1)
+    uint16_t lines = 0;
+    int count = 0;
+    if (BitCount(available_1) == 2 && available_1 == available_2 && available_0 != available_1)
     {
-        std::set_difference(available_cols_0.begin(), available_cols_0.end(), available_cols_1.begin(),
-            available_cols_1.end(), std::back_inserter(res_v));
+        lines = available_0 & ~available_1;
+        count = BitCount(lines);
     }
-    else
+    else if (BitCount(available_0) == 2)
     {
-        if (available_cols_0.size() == 2)
+        if (BitCount(available_1) == 1)
         {
-            if (available_cols_1.size() == 1)
-            {
-                std::set_difference(available_cols_0.begin(), available_cols_0.end(), available_cols_1.begin(),
-                    available_cols_1.end(), std::back_inserter(res_v));
-            }
+            const uint16_t difference = available_0 & ~available_1;
+            lines |= difference;
+            count += BitCount(difference);
         }
-        if (available_cols_0.size() == 2)
+        if (BitCount(available_2) == 1)
         {
-            if (available_cols_2.size() == 1)
-            {
-                std::set_difference(available_cols_0.begin(), available_cols_0.end(), available_cols_2.begin(),
-                    available_cols_2.end(), std::back_inserter(res_v));
-            }
+            const uint16_t difference = available_0 & ~available_2;
+            lines |= difference;
+            count += BitCount(difference);
+        }
+    }
+    return count == 1 ? lines : 0;
+}
+
+void Sudoku::CreateMasks()
+{
+    m_row_numbers.fill(0);
+    m_col_numbers.fill(0);
+    m_square_numbers.fill(0);
+    m_number_cols.fill(0);
+    m_row_empty.fill(0);
+    m_conflicts = 0;
+    m_filled = 0;
+    for (int row = 0; row < 9; ++row)
+    {
+        for (int col = 0; col < 9; ++col)
+        {
+            AddToMasks(row, col, Cell(row, col));
         }
     }
+}
 
-    if (res_v.size() != 1)
+void Sudoku::AddToMasks(int row, int col, int number)
+{
+    if (number == 0)
     {
-        return { false, 0, 0 };
+        m_row_empty[row] |= static_cast<uint16_t>(1u << col);
+        return;
     }
+    const uint16_t bit = NumberBit(number);
+    const int square = SquareIndex(row, col);
+    m_conflicts |= static_cast<uint32_t>((m_row_numbers[row] & bit) != 0) << row;
+    m_conflicts |= static_cast<uint32_t>((m_col_numbers[col] & bit) != 0) << (9 + col);
+    m_conflicts |= static_cast<uint32_t>((m_square_numbers[square] & bit) != 0) << (18 + square);
+    m_row_numbers[row] |= bit;
+    m_col_numbers[col] |= bit;
+    m_square_numbers[square] |= bit;
+    m_number_cols[number - 1] |= static_cast<uint16_t>(1u << col);
+    m_row_empty[row] &= static_cast<uint16_t>(~(1u << col));
+    ++m_filled;
+}
 
-    int final_row = 0;
-    int final_col = res_v.front();
-    bool res = false;
-    for (int row = square.row_begin; row < square.row_end; ++row)
+void Sudoku::RescanUnits(int row, int col)
+{
+    const int square = SquareIndex(row, col);
+    const int square_row = row / 3 * 3;
+    const int square_col = col / 3 * 3;
+
+    // row, col and square of the cell
+    uint16_t numbers[3] = { 0, 0, 0 };
+    uint32_t conflicts[3] = { 0, 0, 0 };
+    uint16_t row_empty = 0;
+    for (int i = 0; i < 9; ++i)
     {
-        if ((*this)(row, final_col) == 0 && !HasRowNumber(row, number))
+        const int values[3] = { Cell(row, i), Cell(i, col), Cell(square_row + i / 3, square_col + i % 3) };
+        for (int unit = 0; unit < 3; ++unit)
         {
-            if (res)
+            if (values[unit] == 0)
             {
-                return { false, 0, 0 };
+                continue;
             }
-            final_row = row;
-            res = true;
+            const uint16_t bit = NumberBit(values[unit]);
+            conflicts[unit] |= (numbers[unit] & bit) != 0;
+            numbers[unit] |= bit;
         }
+        row_empty |= static_cast<uint16_t>((values[0] == 0) << i);
     }
-    return { res, final_row, final_col };
+
+    m_row_numbers[row] = numbers[0];
+    m_col_numbers[col] = numbers[1];
+    m_square_numbers[square] = numbers[2];
+    m_row_empty[row] = row_empty;
+    for (int number = 1; number <= 9; ++number)
+    {
+        const uint16_t has_number = (numbers[1] & NumberBit(number)) != 0;
+        m_number_cols[number - 1] = static_cast<uint16_t>((m_number_cols[number - 1] & ~(1u << col)) | (has_number << col));
+    }
+
+    const uint32_t units = (1u << row) | (1u << (9 + col)) | (1u << (18 + square));
+    m_conflicts = (m_conflicts & ~units) | (conflicts[0] << row) | (conflicts[1] << (9 + col)) |
+        (conflicts[2] << (18 + square));
 }
 
 // ----------------------------------------------------------------------------
 
-SudokuPopularity::SudokuPopularity(const Sudoku& sudoku)
+SudokuSearch::SudokuSearch(const SudokuGrid& grid)
 {
-    for (int number = 1; number <= 9; ++number)
-    {
-        m_number_popularity.push_back({ number, 0 });
-    }
     for (int row = 0; row < 9; ++row)
     {
         for (int col = 0; col < 9; ++col)
         {
-            int number = sudoku(row, col);
-            if (number == 0)
+            int number = grid.Cell(row, col);
+            if (number != 0)
             {
-                continue;
+                Put(row * 9 + col, number);
             }
-            m_number_popularity[number - 1].second += 1;
         }
     }
 }
 
-void SudokuPopularity::SortPopularity()
+bool SudokuSearch::Run()
 {
-    std::sort(m_number_popularity.begin(), m_number_popularity.end(),
-        [](const std::pair<int, int>& lhs, const std::pair<int, int>& rhs) {
-            if (lhs.second == rhs.second)
-            {
-                return lhs.first < rhs.first;
+    int depth = 0;
+    while (true)
+    {
+        int cell = 0;
+        uint16_t candidates = 0;
+        if (!SelectCell(cell, candidates))
+        {
+            return true;
+        }
+        if (candidates != 0)
+        {
+            m_stack[depth++] = { static_cast<uint8_t>(cell), candidates };
+        }
+
+        // place the next candidate of the deepest frame, dropping exhausted frames
+        while (true)
+        {
+            if (depth == 0)
+            {
+                return false;
+            }
+            SudokuSearchFrame& frame = m_stack[depth - 1];
+            if (m_cells[frame.cell] != 0)
+            {
+                Clear(frame.cell);
+                SUDOKU_STAT(++m_backtracks);
             }
-            else
+            if (frame.candidates == 0)
             {
-                return lhs.second > rhs.second;
+                --depth;
+                continue;
             }
-        });
+            int number = LowestBit(frame.candidates) + 1;
+            frame.candidates &= frame.candidates - 1;
+            Put(frame.cell, number);
+            SUDOKU_STAT(++m_nodes);
+            break;
+        }
+    }
 }
 
-void SudokuPopularity::ErasePopularity()
+bool SudokuSearch::SelectCell(int& cell, uint16_t& candidates) const
 {
-    m_number_popularity.erase(
-        std::remove_if(m_number_popularity.begin(), m_number_popularity.end(),
-            [](const std::pair<int, int>& number_popularity) { return number_popularity.second == 9; }),
-        m_number_popularity.end());
+    int best_count = 10;
+    for (int index = 0; index < 81; ++index)
+    {
+        if (m_cells[index] != 0)
+        {
+            continue;
+        }
+        const int row = index / 9;
+        const int col = index % 9;
+        const uint16_t free = ~(m_rows[row] | m_cols[col] | m_squares[(row / 3) * 3 + col / 3]) & 0x1FF;
+        const int count = BitCount(free);
+        if (count < best_count)
+        {
+            best_count = count;
+            cell = index;
+            candidates = free;
+            if (count <= 1)
+            {
+                break;
+            }
+        }
+    }
+    return best_count != 10;
 }
 
-void SudokuPopularity::IncreasePolularity(int number)
+void SudokuSearch::Put(int cell, int number)
+{
+    const int row = cell / 9;
+    const int col = cell % 9;
+    const uint16_t bit = static_cast<uint16_t>(1u << (number - 1));
+    m_cells[cell] = static_cast<uint8_t>(number);
+    m_rows[row] |= bit;
+    m_cols[col] |= bit;
+    m_squares[(row / 3) * 3 + col / 3] |= bit;
+}
+
+void SudokuSearch::Clear(int cell)
+{
+    const int row = cell / 9;
+    const int col = cell % 9;
+    const uint16_t bit = static_cast<uint16_t>(1u << (m_cells[cell] - 1));
+    m_cells[cell] = 0;
+    m_rows[row] &= static_cast<uint16_t>(~bit);
+    m_cols[col] &= static_cast<uint16_t>(~bit);
+    m_squares[(row / 3) * 3 + col / 3] &= static_cast<uint16_t>(~bit);
+}
+
+// ----------------------------------------------------------------------------
+
+namespace
 {
-    for (auto& [value, popularity] : m_number_popularity)
+constexpr const SudokuUnits& UNITS = SudokuGrid::Units();
+
+// Calls found(chosen, united) for every k of the masks, k = 2..limit, whose
+// union has k bits; chosen has bit i for masks[i]. Only the masks in usable
+// take part, a branch stops once the union passes limit bits.
+template <typename Found>
+void FindSubsets(const std::array<uint16_t, 9>& masks, uint16_t usable, int limit, int size, uint16_t chosen,
+    uint16_t united, Found& found)
+{
+    for (; usable != 0; usable &= usable - 1)
     {
-        if (value == number)
+        const int i = LowestBit(usable);
+        const uint16_t with = united | masks[i];
+        const int bits = BitCount(with);
+        if (bits > limit)
         {
-            popularity++;
-            break;
+            continue;
+        }
+        const uint16_t picked = static_cast<uint16_t>(chosen | (1u << i));
+        if (size >= 1 && bits == size + 1)
+        {
+            found(picked, with);
+        }
+        else if (size + 1 < limit)
+        {
+            FindSubsets(masks, usable & (usable - 1), limit, size + 1, picked, with, found);
         }
     }
 }
 
-// ----------------------------------------------------------------------------
+// Largest subset worth a look among the open cells of a unit (or the open
+// lines of a number): k of them are a subset exactly when the other open - k
+// are one of the dual kind, a naked subset for a hidden one and a fish on the
+// rows for one on the cols, so the smaller of the two is enough
+int SubsetLimit(const std::array<uint16_t, 9>& masks)
+{
+    int open = 0;
+    for (uint16_t mask : masks)
+    {
+        open += mask != 0 ? 1 : 0;
+    }
+    return std::min(4, open / 2);
+}
 
-SudokuSolver::SudokuSolver(Sudoku& sudoku) : m_sudoku(sudoku), m_popularity(sudoku)
+// bit i is set when masks[i] has 1 to 4 bits, the masks a subset can be made of
+uint16_t SubsetMasks(const std::array<uint16_t, 9>& masks)
 {
+    uint16_t usable = 0;
+    for (int i = 0; i < 9; ++i)
+    {
+        usable |= static_cast<uint16_t>((masks[i] != 0 && BitCount(masks[i]) <= 4) << i);
+    }
+    return usable;
 }
 
-SudokuResult SudokuSolver::Solve()
+// 81 cells as 9 row masks, bit col of [row] stands for (row, col)
+using SudokuBoard = std::array<uint16_t, 9>;
+
+// the cells that share a row, col or square with at least one of the cells
+SudokuBoard Peers(const SudokuBoard& cells)
 {
-    int count = 0;
-    SudokuResult result;
-    result.valid = m_sudoku.IsSudokuValid();
-    if (!result.valid)
+    uint16_t cols = 0;
+    for (uint16_t row : cells)
     {
-        return result;
+        cols |= row;
     }
-    bool res = true;
-    while (res == true && !m_popularity.IsEmpty())
+    SudokuBoard peers;
+    for (int band = 0; band < 3; ++band)
     {
-        m_popularity.SortPopularity();
+        const uint16_t band_cols = cells[band * 3] | cells[band * 3 + 1] | cells[band * 3 + 2];
+        const uint16_t squares = static_cast<uint16_t>(((band_cols & 0x007) != 0 ? 0x007 : 0) |
+            ((band_cols & 0x038) != 0 ? 0x038 : 0) | ((band_cols & 0x1C0) != 0 ? 0x1C0 : 0));
+        for (int row = band * 3; row < band * 3 + 3; ++row)
+        {
+            peers[row] = static_cast<uint16_t>((cells[row] != 0 ? 0x1FF : 0) | cols | squares);
+        }
+    }
+    return peers;
+}
+
+// true when two of the cells share a row, col or square
+bool SharesUnit(const SudokuBoard& cells)
+{
+    uint16_t cols = 0;
+    for (int band = 0; band < 3; ++band)
+    {
+        int square_cells[3] = {};
+        for (int row = band * 3; row < band * 3 + 3; ++row)
+        {
+            if (BitCount(cells[row]) > 1 || (cols & cells[row]) != 0)
+            {
+                return true;
+            }
+            cols |= cells[row];
+            for (int stack = 0; stack < 3; ++stack)
+            {
+                square_cells[stack] += BitCount((cells[row] >> (3 * stack)) & 0x7);
+            }
+        }
+        if (square_cells[0] > 1 || square_cells[1] > 1 || square_cells[2] > 1)
+        {
+            return true;
+        }
+    }
+    return false;
+}
 
-        res = false;
+// bit i is set when positions has a bit in [3 * i, 3 * i + 3): the rows of a
+// square or the squares of a line
+uint16_t Thirds(uint16_t positions)
+{
+    return static_cast<uint16_t>(((positions & 0x007) != 0) | (((positions & 0x038) != 0) << 1) |
+        (((positions & 0x1C0) != 0) << 2));
+}
 
-        if (!res)
+// the cols of a square
+uint16_t SquareCols(uint16_t positions)
+{
+    return (positions | (positions >> 3) | (positions >> 6)) & 0x7;
+}
+}
+
+SudokuCandidates::SudokuCandidates(const SudokuGrid& grid)
+{
+    Reset(grid);
+}
+
+void SudokuCandidates::Reset(const SudokuGrid& grid)
+{
+    // numbers of every unit, the units that hold every number ([number] has
+    // bit row, col or square, [0] collects the empty cells), and bit col of
+    // empty_cols[row] (bit row of empty_rows[col]) for an empty cell; no
+    // branches on the givens
+    std::array<uint16_t, 27> taken = {};
+    std::array<uint16_t, 10> rows_with = {};
+    std::array<uint16_t, 10> cols_with = {};
+    std::array<uint16_t, 10> squares_with = {};
+    std::array<uint16_t, 9> empty_cols = {};
+    std::array<uint16_t, 9> empty_rows = {};
+    for (int row = 0; row < 9; ++row)
+    {
+        for (int col = 0; col < 9; ++col)
+        {
+            const int square = (row / 3) * 3 + col / 3;
+            const int number = grid.Cell(row, col);
+            const uint16_t bit = static_cast<uint16_t>((1u << number) >> 1);
+            const unsigned empty = number == 0;
+            taken[row] |= bit;
+            taken[9 + col] |= bit;
+            taken[18 + square] |= bit;
+            rows_with[number] |= static_cast<uint16_t>(1u << row);
+            cols_with[number] |= static_cast<uint16_t>(1u << col);
+            squares_with[number] |= static_cast<uint16_t>(1u << square);
+            empty_cols[row] |= static_cast<uint16_t>(empty << col);
+            empty_rows[col] |= static_cast<uint16_t>(empty << row);
+        }
+    }
+    for (int row = 0; row < 9; ++row)
+    {
+        for (int col = 0; col < 9; ++col)
         {
-            for (auto [number, popularity] : m_popularity)
+            const uint16_t free = static_cast<uint16_t>(
+                ~(taken[row] | taken[9 + col] | taken[18 + (row / 3) * 3 + col / 3]) & 0x1FF);
+            m_cells[row * 9 + col] = ((empty_cols[row] >> col) & 1u) != 0 ? free : 0;
+        }
+    }
+
+    // a number can go to the empty cells outside the rows, cols and squares
+    // that hold it
+    for (int number = 0; number < 9; ++number)
+    {
+        const unsigned squares = squares_with[number + 1];
+        for (int third = 0; third < 3; ++third)
+        {
+            // the cols of the squares of the band holding the number, the rows for the stack
+            const unsigned band = squares >> (3 * third);
+            const unsigned stack = squares >> third;
+            const uint16_t blocked_cols = static_cast<uint16_t>(cols_with[number + 1] |
+                ((band & 1u) * 0x007) | (((band >> 1) & 1u) * 0x038) | (((band >> 2) & 1u) * 0x1C0));
+            const uint16_t blocked_rows = static_cast<uint16_t>(rows_with[number + 1] |
+                ((stack & 1u) * 0x007) | (((stack >> 3) & 1u) * 0x038) | (((stack >> 6) & 1u) * 0x1C0));
+            for (int line = third * 3; line < third * 3 + 3; ++line)
             {
-                if (SolveCrossingOut(number, result.solution_steps))
-                {
-                    res = true;
-                }
+                m_rows[number][line] = ((rows_with[number + 1] >> line) & 1u) != 0 ? 0 :
+                    static_cast<uint16_t>(empty_cols[line] & ~blocked_cols);
+                m_cols[number][line] = ((cols_with[number + 1] >> line) & 1u) != 0 ? 0 :
+                    static_cast<uint16_t>(empty_rows[line] & ~blocked_rows);
+            }
+        }
+    }
+    m_dirty_cells.fill(0x1FF);
+    m_dirty_units.fill((1u << 27) - 1);
+    m_changed = 0;
+    m_stale.fill(ALL_CHANGED);
+    SUDOKU_STAT(m_examined = 0);
+}
+
+void SudokuCandidates::Place(int index, int number)
+{
+    const int row = index / 9;
+    const int col = index % 9;
+    Clear(index, m_cells[index]);
+
+    // the peers that still have the number, read from the bitboards: the
+    // row, the col, then the rest of the square
+    const uint16_t bit = static_cast<uint16_t>(1u << (number - 1));
+    std::array<uint16_t, 9>& rows = m_rows[number - 1];
+    std::array<uint16_t, 9>& cols = m_cols[number - 1];
+    uint32_t dirty_units = 0;
+    for (uint16_t lost = rows[row]; lost != 0; lost &= lost - 1)
+    {
+        const int peer = LowestBit(lost);
+        m_cells[row * 9 + peer] &= static_cast<uint16_t>(~bit);
+        cols[peer] &= static_cast<uint16_t>(~(1u << row));
+        dirty_units |= UNITS.of[row * 9 + peer];
+    }
+    m_dirty_cells[row] |= rows[row];
+    rows[row] = 0;
+    for (uint16_t lost = cols[col]; lost != 0; lost &= lost - 1)
+    {
+        const int peer = LowestBit(lost);
+        m_cells[peer * 9 + col] &= static_cast<uint16_t>(~bit);
+        rows[peer] &= static_cast<uint16_t>(~(1u << col));
+        m_dirty_cells[peer] |= static_cast<uint16_t>(1u << col);
+        dirty_units |= UNITS.of[peer * 9 + col];
+    }
+    cols[col] = 0;
+    const uint16_t square_cols = static_cast<uint16_t>(0x7u << (3 * (col / 3)));
+    for (int line = row / 3 * 3; line < row / 3 * 3 + 3; ++line)
+    {
+        const uint16_t lost = rows[line] & square_cols;
+        for (uint16_t peers = lost; peers != 0; peers &= peers - 1)
+        {
+            const int peer = LowestBit(peers);
+            m_cells[line * 9 + peer] &= static_cast<uint16_t>(~bit);
+            cols[peer] &= static_cast<uint16_t>(~(1u << line));
+            dirty_units |= UNITS.of[line * 9 + peer];
+        }
+        rows[line] &= static_cast<uint16_t>(~lost);
+        m_dirty_cells[line] |= lost;
+    }
+    m_dirty_units[number - 1] |= dirty_units;
+    m_changed |= dirty_units | static_cast<uint64_t>(bit) << 32;
+}
+
+bool SudokuCandidates::ReducePointing()
+{
+    bool res = false;
+    std::array<uint16_t, 9> positions;
+    for (uint64_t squares = (TakeStale(POINTING) >> 18) & 0x1FF; squares != 0; squares &= squares - 1)
+    {
+        const int square = LowestBit(static_cast<unsigned>(squares));
+        Positions(18 + square, positions);
+        const int band = square / 3;
+        const int stack = square % 3;
+        for (int number = 0; number < 9; ++number)
+        {
+            const uint16_t rows = Thirds(positions[number]);
+            const uint16_t cols = SquareCols(positions[number]);
+            const uint16_t bit = static_cast<uint16_t>(1u << number);
+            // a single row (col) of the square, the other two squares of the line lose the number
+            if (BitCount(rows) == 1)
+            {
+                res |= Remove(band * 3 + LowestBit(rows), static_cast<uint16_t>(~(0x7u << (3 * stack)) & 0x1FF), bit);
+            }
+            if (BitCount(cols) == 1)
+            {
+                res |= Remove(9 + stack * 3 + LowestBit(cols), static_cast<uint16_t>(~(0x7u << (3 * band)) & 0x1FF),
+                    bit);
             }
         }
+    }
+    return res;
+}
 
-        if (!res)
+bool SudokuCandidates::ReduceBoxLine()
+{
+    bool res = false;
+    std::array<uint16_t, 9> positions;
+    for (uint64_t units = TakeStale(BOX_LINE) & 0x3FFFF; units != 0; units &= units - 1)
+    {
+        const int unit = LowestBit(static_cast<unsigned>(units));
+        const int line = unit % 9;
+        Positions(unit, positions);
+        for (int number = 0; number < 9; ++number)
         {
-            for (auto [number, popularity] : m_popularity)
+            const uint16_t thirds = Thirds(positions[number]);
+            if (BitCount(thirds) != 1)
             {
-                if (SolveDoubleGuess(number, result.solution_steps))
+                continue;
+            }
+            // the other two lines of the square lose the number
+            const int third = LowestBit(thirds);
+            const int square = unit < 9 ? (line / 3) * 3 + third : third * 3 + line / 3;
+            const uint16_t others = unit < 9 ? static_cast<uint16_t>(~(0x7u << (3 * (line % 3))) & 0x1FF) :
+                static_cast<uint16_t>(~(0x49u << (line % 3)) & 0x1FF);
+            res |= Remove(18 + square, others, static_cast<uint16_t>(1u << number));
+        }
+    }
+    return res;
+}
+
+bool SudokuCandidates::ReduceNakedSubsets()
+{
+    bool res = false;
+    for (uint64_t units = TakeStale(NAKED_SUBSETS) & 0x7FFFFFF; units != 0; units &= units - 1)
+    {
+        const int unit = LowestBit(static_cast<unsigned>(units));
+        std::array<uint16_t, 9> cells;
+        uint16_t empty = 0;
+        for (int i = 0; i < 9; ++i)
+        {
+            cells[i] = m_cells[UNITS.cells[unit][i]];
+            empty |= static_cast<uint16_t>((cells[i] != 0) << i);
+        }
+        // the masks are not refreshed after a removal, a subset of stale
+        // (larger) masks is still a subset
+        auto found = [this, unit, empty, &res](uint16_t subset, uint16_t numbers) {
+            res |= Remove(unit, empty & ~subset, numbers);
+        };
+        const uint16_t usable = SubsetMasks(cells);
+        // a subset has to leave another empty cell to clear
+        if (BitCount(usable) >= 2 && BitCount(empty) >= 3)
+        {
+            FindSubsets(cells, usable, SubsetLimit(cells), 0, 0, 0, found);
+        }
+    }
+    return res;
+}
+
+bool SudokuCandidates::ReduceHiddenSubsets()
+{
+    bool res = false;
+    std::array<uint16_t, 9> positions;
+    for (uint64_t units = TakeStale(HIDDEN_SUBSETS) & 0x7FFFFFF; units != 0; units &= units - 1)
+    {
+        const int unit = LowestBit(static_cast<unsigned>(units));
+        Positions(unit, positions);
+        auto found = [this, unit, &res](uint16_t numbers, uint16_t places) {
+            res |= Remove(unit, places, static_cast<uint16_t>(~numbers & 0x1FF));
+        };
+        const uint16_t usable = SubsetMasks(positions);
+        if (BitCount(usable) >= 2)
+        {
+            FindSubsets(positions, usable, SubsetLimit(positions), 0, 0, 0, found);
+        }
+    }
+    return res;
+}
+
+bool SudokuCandidates::ReduceFish()
+{
+    bool res = false;
+    for (uint64_t numbers = TakeStale(FISH) >> 32; numbers != 0; numbers &= numbers - 1)
+    {
+        const int number = LowestBit(static_cast<unsigned>(numbers));
+        const uint16_t bit = static_cast<uint16_t>(1u << number);
+        // rows as base and cols as cover, then the other way round
+        for (int base = 0; base < 18; base += 9)
+        {
+            const SudokuBoard lines = base == 0 ? m_rows[number] : m_cols[number];
+            auto found = [this, base, bit, &lines, &res](uint16_t fish, uint16_t cover) {
+                for (uint16_t others = static_cast<uint16_t>(~fish & 0x1FF); others != 0; others &= others - 1)
                 {
-                    res = true;
+                    const int line = LowestBit(others);
+                    if ((lines[line] & cover) != 0)
+                    {
+                        res |= Remove(base + line, cover, bit);
+                    }
                 }
+            };
+            const uint16_t usable = SubsetMasks(lines);
+            if (BitCount(usable) >= 2)
+            {
+                FindSubsets(lines, usable, SubsetLimit(lines), 0, 0, 0, found);
+            }
+        }
+    }
+    return res;
+}
+
+bool SudokuCandidates::ReduceColoring()
+{
+    bool res = false;
+    for (uint64_t numbers = TakeStale(COLORING) >> 32; numbers != 0; numbers &= numbers - 1)
+    {
+        const int number = LowestBit(static_cast<unsigned>(numbers));
+        // up to three partners per cell, one for each unit with two places
+        std::array<std::array<uint8_t, 3>, 81> partners;
+        std::array<uint8_t, 81> partner_counts = {};
+        SudokuBoard linked = {};
+        for (int unit = 0; unit < 27; ++unit)
+        {
+            const uint16_t places = Places(unit, number);
+            if (BitCount(places) != 2)
+            {
+                continue;
             }
+            const int first = UNITS.cells[unit][LowestBit(places)];
+            const int second = UNITS.cells[unit][LowestBit(places & (places - 1))];
+            partners[first][partner_counts[first]++] = static_cast<uint8_t>(second);
+            partners[second][partner_counts[second]++] = static_cast<uint8_t>(first);
+            linked[first / 9] |= static_cast<uint16_t>(1u << (first % 9));
+            linked[second / 9] |= static_cast<uint16_t>(1u << (second % 9));
         }
 
-        if (!res)
+        SudokuBoard uncolored = linked;
+        for (int row = 0; row < 9; ++row)
         {
-            for (auto [number, popularity] : m_popularity)
+            while (uncolored[row] != 0)
             {
-                if (SolveTripleGuess(number, result.solution_steps))
+                // the chain of the first uncolored cell, colors[0] holds the start
+                std::array<SudokuBoard, 2> colors = {};
+                std::array<uint8_t, 81> stack;
+                int depth = 0;
+                stack[depth++] = static_cast<uint8_t>(row * 9 + LowestBit(uncolored[row]));
+                colors[0][row] |= uncolored[row] & (~uncolored[row] + 1);
+                uncolored[row] &= uncolored[row] - 1;
+                while (depth > 0)
+                {
+                    const int cell = stack[--depth];
+                    const int color = (colors[1][cell / 9] >> (cell % 9)) & 1;
+                    for (int i = 0; i < partner_counts[cell]; ++i)
+                    {
+                        const int partner = partners[cell][i];
+                        const uint16_t partner_bit = static_cast<uint16_t>(1u << (partner % 9));
+                        if ((uncolored[partner / 9] & partner_bit) != 0)
+                        {
+                            uncolored[partner / 9] &= static_cast<uint16_t>(~partner_bit);
+                            colors[color ^ 1][partner / 9] |= partner_bit;
+                            stack[depth++] = static_cast<uint8_t>(partner);
+                        }
+                    }
+                }
+
+                // a color that sees itself is false, otherwise the cells that see both colors lose the number
+                SudokuBoard cleared;
+                if (SharesUnit(colors[0]) || SharesUnit(colors[1]))
                 {
-                    res = true;
+                    cleared = SharesUnit(colors[0]) ? colors[0] : colors[1];
+                }
+                else
+                {
+                    const SudokuBoard seen_0 = Peers(colors[0]);
+                    const SudokuBoard seen_1 = Peers(colors[1]);
+                    for (int line = 0; line < 9; ++line)
+                    {
+                        cleared[line] = seen_0[line] & seen_1[line] & ~(colors[0][line] | colors[1][line]);
+                    }
+                }
+                for (int line = 0; line < 9; ++line)
+                {
+                    res |= Remove(line, cleared[line], static_cast<uint16_t>(1u << number));
                 }
             }
         }
+    }
+    return res;
+}
 
-        if (++count == 25) {
-            throw std::runtime_error("Count has achived it's maximum value that equals 25");
+size_t SudokuCandidates::TakeSingles(std::array<SudokuSingle, 81 * 2>& singles)
+{
+    // squares, then rows and cols, then cells; a part is looked at only when
+    // the parts before it found nothing, the rest stays dirty
+    const auto single = [](uint16_t places) { return places != 0 && (places & (places - 1)) == 0; };
+    size_t count = 0;
+    for (int number = 0; number < 9; ++number)
+    {
+        for (uint32_t squares = m_dirty_units[number] >> 18; squares != 0; squares &= squares - 1)
+        {
+            const int square = LowestBit(squares);
+            SUDOKU_STAT(++m_examined);
+            const uint16_t places = Places(18 + square, number);
+            if (single(places))
+            {
+                singles[count++] = { UNITS.cells[18 + square][LowestBit(places)], static_cast<uint8_t>(number + 1),
+                    SudokuTechnique::CrossingOut };
+            }
         }
+        m_dirty_units[number] &= 0x3FFFFu;
+    }
+    if (count != 0)
+    {
+        return count;
+    }
+    for (int number = 0; number < 9; ++number)
+    {
+        for (uint32_t lines = m_dirty_units[number]; lines != 0; lines &= lines - 1)
+        {
+            const int line = LowestBit(lines);
+            SUDOKU_STAT(++m_examined);
+            const uint16_t places = line < 9 ? m_rows[number][line] : m_cols[number][line - 9];
+            if (single(places))
+            {
+                singles[count++] = { UNITS.cells[line][LowestBit(places)], static_cast<uint8_t>(number + 1),
+                    SudokuTechnique::HiddenSingle };
+            }
+        }
+        m_dirty_units[number] = 0;
+    }
+    if (count != 0)
+    {
+        return count;
+    }
+    for (int row = 0; row < 9; ++row)
+    {
+        for (uint16_t cols = m_dirty_cells[row]; cols != 0; cols &= cols - 1)
+        {
+            const int index = row * 9 + LowestBit(cols);
+            SUDOKU_STAT(++m_examined);
+            const uint16_t candidates = m_cells[index];
+            if (candidates != 0 && (candidates & (candidates - 1)) == 0)
+            {
+                singles[count++] = { static_cast<uint8_t>(index), static_cast<uint8_t>(LowestBit(candidates) + 1),
+                    SudokuTechnique::NakedSingle };
+            }
+        }
+        m_dirty_cells[row] = 0;
+    }
+    return count;
+}
+
+uint64_t SudokuCandidates::TakeStale(SudokuReduction reduction)
+{
+    // the changes go to every reduction at once, the next one to run takes its share
+    for (uint64_t& stale : m_stale)
+    {
+        stale |= m_changed;
+    }
+    m_changed = 0;
+    const uint64_t stale = m_stale[reduction];
+    m_stale[reduction] = 0;
+    return stale;
+}
+
+void SudokuCandidates::Positions(int unit, std::array<uint16_t, 9>& positions) const
+{
+    for (int number = 0; number < 9; ++number)
+    {
+        positions[number] = Places(unit, number);
+    }
+}
+
+uint16_t SudokuCandidates::Places(int unit, int number) const
+{
+    if (unit < 18)
+    {
+        return unit < 9 ? m_rows[number][unit] : m_cols[number][unit - 9];
+    }
+    const std::array<uint16_t, 9>& rows = m_rows[number];
+    const int band = (unit - 18) / 3;
+    const int shift = 3 * ((unit - 18) % 3);
+    return static_cast<uint16_t>(((rows[band * 3] >> shift) & 0x7) | (((rows[band * 3 + 1] >> shift) & 0x7) << 3) |
+        (((rows[band * 3 + 2] >> shift) & 0x7) << 6));
+}
+
+bool SudokuCandidates::Remove(int unit, uint16_t positions, uint16_t numbers)
+{
+    bool res = false;
+    for (; positions != 0; positions &= positions - 1)
+    {
+        const int index = UNITS.cells[unit][LowestBit(positions)];
+        const uint16_t removed = m_cells[index] & numbers;
+        if (removed != 0)
+        {
+            Clear(index, removed);
+            res = true;
+        }
+    }
+    return res;
+}
+
+void SudokuCandidates::Touch(int index, uint16_t numbers)
+{
+    m_dirty_cells[index / 9] |= static_cast<uint16_t>(1u << (index % 9));
+    m_changed |= UNITS.of[index] | static_cast<uint64_t>(numbers) << 32;
+    for (; numbers != 0; numbers &= numbers - 1)
+    {
+        m_dirty_units[LowestBit(numbers)] |= UNITS.of[index];
+    }
+}
+
+void SudokuCandidates::Clear(int index, uint16_t numbers)
+{
+    const int row = index / 9;
+    const int col = index % 9;
+    m_cells[index] &= static_cast<uint16_t>(~numbers);
+    if (numbers != 0)
+    {
+        Touch(index, numbers);
+    }
+    for (; numbers != 0; numbers &= numbers - 1)
+    {
+        const int number = LowestBit(numbers);
+        m_rows[number][row] &= static_cast<uint16_t>(~(1u << col));
+        m_cols[number][col] &= static_cast<uint16_t>(~(1u << row));
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+SudokuPopularity::SudokuPopularity(const Sudoku& sudoku)
+{
+    Reset(sudoku);
+}
 
-        m_popularity.ErasePopularity();
+void SudokuPopularity::Reset(const Sudoku& sudoku)
+{
+    m_counts.fill(0);
+    for (int index = 0; index < 81; ++index)
+    {
+        const int number = sudoku.Cell(index);
+        if (number != 0 && m_counts[number - 1] < 9)
+        {
+            ++m_counts[number - 1];
+        }
+    }
+    m_buckets.fill(0);
+    for (int number = 0; number < 9; ++number)
+    {
+        m_buckets[m_counts[number]] |= static_cast<uint16_t>(1u << number);
+    }
+    m_order_size = 0;
+}
+
+void SudokuPopularity::SortPopularity()
+{
+    m_order_size = 0;
+    for (int count = 8; count >= 0; --count)
+    {
+        for (uint16_t numbers = m_buckets[count]; numbers != 0; numbers &= numbers - 1)
+        {
+            m_order[m_order_size++] = { LowestBit(numbers) + 1, count };
+        }
+    }
+}
+
+void SudokuPopularity::IncreasePolularity(int number)
+{
+    const int count = m_counts[number - 1];
+    if (count == 9)
+    {
+        return;
     }
+    const uint16_t bit = static_cast<uint16_t>(1u << (number - 1));
+    m_buckets[count] &= static_cast<uint16_t>(~bit);
+    m_buckets[count + 1] |= bit;
+    m_counts[number - 1] = static_cast<uint8_t>(count + 1);
+}
+
+// ----------------------------------------------------------------------------
+
+#ifdef SUDOKU_STATS
+namespace
+{
+// nanoseconds since the last lap, which starts the next one
+uint64_t Lap(std::chrono::steady_clock::time_point& last)
+{
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last);
+    last = now;
+    return static_cast<uint64_t>(elapsed.count());
+}
+}
+#endif
 
-    result.valid = m_sudoku.IsSudokuValid();
+SudokuSolver::SudokuSolver(Sudoku& sudoku)
+{
+    Reset(sudoku);
+}
+
+SudokuResult SudokuSolver::Solve()
+{
+    SudokuResult result;
+    Solve(result);
     return result;
 }
 
-bool SudokuSolver::SolveCrossingOut(int number, std::vector<std::string>& solutions)
+void SudokuSolver::Solve(SudokuResult& result)
+{
+    assert(m_sudoku != nullptr);
+    SUDOKU_STAT(std::chrono::steady_clock::time_point lap = std::chrono::steady_clock::now());
+    m_trace = m_tracer != nullptr ? m_tracer->Sample() : nullptr;
+    SudokuTraceScope solve_trace(m_trace, "solve");
+    result.Clear();
+    result.solution_steps.reserve(81);
+    m_pass = 0;
+    {
+        SudokuTraceScope trace(m_trace, "validate");
+        if (m_metrics != nullptr)
+        {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            result.valid = m_sudoku->IsSudokuValid();
+            const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start);
+            m_metrics->RecordValidation(static_cast<uint64_t>(elapsed.count()));
+        }
+        else
+        {
+            result.valid = m_sudoku->IsSudokuValid();
+        }
+    }
+    if (!result.valid)
+    {
+        SUDOKU_STAT(result.stats.setup_ns = Lap(lap));
+        return;
+    }
+    m_popularity.Reset(*m_sudoku);
+    m_has_candidates = false;
+    SUDOKU_STAT(result.stats.setup_ns = Lap(lap));
+    bool res = true;
+    while (res == true && !m_popularity.IsEmpty())
+    {
+        ++m_pass;
+        m_popularity.SortPopularity();
+
+        {
+            SudokuTraceScope trace(m_trace, "singles", static_cast<uint32_t>(m_pass));
+            res = SolveSingles(result);
+        }
+
+        if (!res)
+        {
+            SudokuStrategy::SudokuStageOrder stages = SudokuStrategy::FIXED_ORDER;
+            if (m_strategy != nullptr)
+            {
+                m_strategy->Order(stages);
+            }
+            for (size_t stage = 0; !res && stage < stages.size(); ++stage)
+            {
+                res = SolveStage(stages[stage], result);
+            }
+        }
+    }
+
+    // the stages are timed on their own, the rest of the loop is the singles
+#ifdef SUDOKU_STATS
+    result.stats.singles_ns = Lap(lap);
+    for (uint64_t stage_ns : result.stats.stage_ns)
+    {
+        result.stats.singles_ns -= stage_ns;
+    }
+    result.stats.cells_examined += m_has_candidates ? m_candidates.Examined() : 0;
+    result.stats.passes = static_cast<uint32_t>(m_pass + (m_popularity.IsEmpty() ? 0 : 1));
+#endif
+
+    if (!m_popularity.IsEmpty())
+    {
+        ++m_pass;
+        bool solved = false;
+        {
+            SudokuTraceScope trace(m_trace, "search", static_cast<uint32_t>(m_pass));
+            solved = SolveSearch(result);
+        }
+        SUDOKU_STAT(result.stats.search_ns = Lap(lap));
+        if (!solved)
+        {
+            result.valid = SudokuValid::Error(SudokuError::NoSolution);
+            return;
+        }
+        result.Use(SudokuTechnique::Search);
+    }
+
+    result.valid = m_sudoku->IsSudokuValid();
+}
+
+void SudokuSolver::PutNumber(int row, int col, int number, SudokuTechnique technique,
+    std::vector<SudokuStep>& solutions)
+{
+    m_sudoku->PutNumberUnchecked(row, col, number);
+    m_popularity.IncreasePolularity(number);
+    if (m_has_candidates)
+    {
+        m_candidates.Place(row * 9 + col, number);
+    }
+    solutions.push_back({ static_cast<uint8_t>(number), static_cast<uint8_t>(row * 9 + col),
+        static_cast<uint8_t>(technique), static_cast<uint8_t>(m_pass) });
+}
+
+bool SudokuSolver::SolveSingles(SudokuResult& result)
+{
+    if (!m_has_candidates)
+    {
+        bool res = false;
+        for (auto [number, popularity] : m_popularity)
+        {
+            res |= SolveCrossingOut(number, result);
+        }
+        SUDOKU_STAT(++result.stats.calls[static_cast<size_t>(SudokuTechnique::CrossingOut)]);
+        SUDOKU_STAT(result.stats.hits[static_cast<size_t>(SudokuTechnique::CrossingOut)] += res ? 1 : 0);
+        if (res)
+        {
+            result.Use(SudokuTechnique::CrossingOut);
+            return true;
+        }
+        // crossing out stalled, the candidates take over from here
+        m_candidates.Reset(*m_sudoku);
+        m_has_candidates = true;
+    }
+
+    std::array<SudokuCandidates::SudokuSingle, 81 * 2> singles;
+    size_t count = 0;
+    // a batch may be stale only when an earlier single of it took the cell
+    while ((count = m_candidates.TakeSingles(singles)) != 0)
+    {
+        bool res = false;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto [cell, number, technique] = singles[i];
+            if ((m_candidates.Cell(cell) & (1u << (number - 1))) != 0)
+            {
+                PutNumber(cell / 9, cell % 9, number, technique, result.solution_steps);
+                res = true;
+            }
+        }
+        // a batch of a technique means the ones before it were looked for and found nothing
+#ifdef SUDOKU_STATS
+        for (size_t technique = 0; technique <= static_cast<size_t>(singles[0].technique); ++technique)
+        {
+            ++result.stats.calls[technique];
+        }
+        result.stats.hits[static_cast<size_t>(singles[0].technique)] += res ? 1 : 0;
+#endif
+        if (res)
+        {
+            result.Use(singles[0].technique);
+            return true;
+        }
+    }
+    // all three were looked for
+#ifdef SUDOKU_STATS
+    for (SudokuTechnique technique :
+        { SudokuTechnique::CrossingOut, SudokuTechnique::HiddenSingle, SudokuTechnique::NakedSingle })
+    {
+        ++result.stats.calls[static_cast<size_t>(technique)];
+    }
+#endif
+    return false;
+}
+
+bool SudokuSolver::SolveCrossingOut(int number, SudokuResult& result)
 {
     bool res = false;
-    for (const auto& square : m_sudoku.Squares())
+    for (const auto& square : m_sudoku->Squares())
     {
-        if (!m_sudoku.HasSquareNumber(square, number))
+        if (!m_sudoku->HasSquareNumber(square, number))
         {
-            Sudoku::SudokuFoundPlace place = m_sudoku.SearchUsingCrossingOut(square, number);
+            SUDOKU_STAT(++result.stats.cells_examined);
+            Sudoku::SudokuFoundPlace place = m_sudoku->SearchUsingCrossingOut(square, number);
             if (place)
             {
-                m_sudoku(place.row, place.col) = number;
-                m_popularity.IncreasePolularity(number);
+                PutNumber(place.row, place.col, number, SudokuTechnique::CrossingOut, result.solution_steps);
                 res = true;
-                solutions.push_back("Put number "s + std::to_string(number) + " in row "s + std::to_string(place.row) +
-                    " col "s + std::to_string(place.col));
             }
         }
     }
     return res;
 }
 
-bool SudokuSolver::SolveDoubleGuess(int number, std::vector<std::string>& solutions)
+bool SudokuSolver::SolveStage(SudokuStage stage, SudokuResult& result)
 {
+    using Clock = std::chrono::steady_clock;
+#ifdef SUDOKU_STATS
+    const bool timed = true;
+#else
+    const bool timed = m_strategy != nullptr;
+#endif
+    const Clock::time_point start = timed ? Clock::now() : Clock::time_point();
+    SudokuTraceScope trace(m_trace, StageName(stage), static_cast<uint32_t>(m_pass));
     bool res = false;
-    for (const auto& square : m_sudoku.Squares())
+    switch (stage)
     {
-        if (!m_sudoku.HasSquareNumber(square, number))
+    case SudokuStage::DoubleGuess:
+        for (auto [number, popularity] : m_popularity)
         {
-            Sudoku::SudokuFoundPlace place = m_sudoku.SearchUsingDoubleGuess(square, number);
+            if (SolveDoubleGuess(number, result.solution_steps))
+            {
+                res = true;
+                result.Use(SudokuTechnique::DoubleGuess);
+            }
+        }
+        SUDOKU_STAT(++result.stats.calls[static_cast<size_t>(SudokuTechnique::DoubleGuess)]);
+        SUDOKU_STAT(result.stats.hits[static_cast<size_t>(SudokuTechnique::DoubleGuess)] += res ? 1 : 0);
+        break;
+    case SudokuStage::TripleGuess:
+        for (auto [number, popularity] : m_popularity)
+        {
+            if (SolveTripleGuess(number, result.solution_steps))
+            {
+                res = true;
+                result.Use(SudokuTechnique::TripleGuess);
+            }
+        }
+        SUDOKU_STAT(++result.stats.calls[static_cast<size_t>(SudokuTechnique::TripleGuess)]);
+        SUDOKU_STAT(result.stats.hits[static_cast<size_t>(SudokuTechnique::TripleGuess)] += res ? 1 : 0);
+        break;
+    case SudokuStage::Candidates:
+        res = SolveCandidates(result);
+        break;
+    default:
+        break;
+    }
+    if (timed)
+    {
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+        SUDOKU_STAT(result.stats.stage_ns[static_cast<size_t>(stage)] += static_cast<uint64_t>(elapsed.count()));
+        if (m_strategy != nullptr)
+        {
+            m_strategy->Report(stage, static_cast<uint64_t>(elapsed.count()), res);
+        }
+    }
+    return res;
+}
+
+bool SudokuSolver::SolveDoubleGuess(int number, std::vector<SudokuStep>& solutions)
+{
+    bool res = false;
+    for (const auto& square : m_sudoku->Squares())
+    {
+        if (!m_sudoku->HasSquareNumber(square, number))
+        {
+            Sudoku::SudokuFoundPlace place = m_sudoku->SearchUsingDoubleGuess(square, number);
             if (place)
             {
-                m_sudoku(place.row, place.col) = number;
-                m_popularity.IncreasePolularity(number);
+                PutNumber(place.row, place.col, number, SudokuTechnique::DoubleGuess, solutions);
                 res = true;
-                solutions.push_back("Put number "s + std::to_string(number) + " in row "s + std::to_string(place.row) +
-                    " col "s + std::to_string(place.col));
             }
         }
     }
     return res;
 }
 
-bool SudokuSolver::SolveTripleGuess(int number, std::vector<std::string>& solutions)
+bool SudokuSolver::SolveTripleGuess(int number, std::vector<SudokuStep>& solutions)
 {
     bool res = false;
-    for (const auto& square : m_sudoku.Squares())
+    for (const auto& square : m_sudoku->Squares())
     {
-        if (!m_sudoku.HasSquareNumber(square, number))
+        if (!m_sudoku->HasSquareNumber(square, number))
         {
-            Sudoku::SudokuFoundPlace place = m_sudoku.SearchUsingTripleGuess(square, number);
+            Sudoku::SudokuFoundPlace place = m_sudoku->SearchUsingTripleGuess(square, number);
             if (place)
             {
-                m_sudoku(place.row, place.col) = number;
-                m_popularity.IncreasePolularity(number);
+                PutNumber(place.row, place.col, number, SudokuTechnique::TripleGuess, solutions);
                 res = true;
-                solutions.push_back("Put number "s + std::to_string(number) + " in row "s + std::to_string(place.row) +
-                    " col "s + std::to_string(place.col));
             }
         }
     }
     return res;
 }
+
+bool SudokuSolver::SolveCandidates(SudokuResult& result)
+{
+    static constexpr std::pair<SudokuTechnique, bool (SudokuCandidates::*)()> REDUCTIONS[] = {
+        { SudokuTechnique::Pointing, &SudokuCandidates::ReducePointing },
+        { SudokuTechnique::BoxLine, &SudokuCandidates::ReduceBoxLine },
+        { SudokuTechnique::NakedSubset, &SudokuCandidates::ReduceNakedSubsets },
+        { SudokuTechnique::HiddenSubset, &SudokuCandidates::ReduceHiddenSubsets },
+        { SudokuTechnique::Fish, &SudokuCandidates::ReduceFish },
+        { SudokuTechnique::Coloring, &SudokuCandidates::ReduceColoring },
+    };
+    // pointing and box-line pay for themselves, the others cost more than
+    // the search they spare and only name the technique for a rating
+    const size_t reductions = m_rating ? std::size(REDUCTIONS) : 2;
+    std::array<SudokuCandidates::SudokuSingle, 81 * 2> singles;
+    size_t reduction = 0;
+    while (reduction < reductions)
+    {
+        const auto [technique, reduce] = REDUCTIONS[reduction];
+        const bool reduced = (m_candidates.*reduce)();
+        SUDOKU_STAT(++result.stats.calls[static_cast<size_t>(technique)]);
+        SUDOKU_STAT(result.stats.hits[static_cast<size_t>(technique)] += reduced ? 1 : 0);
+        if (!reduced)
+        {
+            ++reduction;
+            continue;
+        }
+        // the first batch of singles the reduction left is credited to it,
+        // the other singles are left to the next pass
+        bool res = false;
+        const size_t count = m_candidates.TakeSingles(singles);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto [cell, number, single] = singles[i];
+            if ((m_candidates.Cell(cell) & (1u << (number - 1))) != 0)
+            {
+                PutNumber(cell / 9, cell % 9, number, technique, result.solution_steps);
+                res = true;
+            }
+        }
+        if (res)
+        {
+            result.Use(technique);
+            return true;
+        }
+        reduction = 0;
+    }
+    return false;
+}
+
+bool SudokuSolver::SolveSearch(SudokuResult& result)
+{
+    SudokuSearch search(*m_sudoku);
+    const bool solved = search.Run();
+#ifdef SUDOKU_STATS
+    ++result.stats.calls[static_cast<size_t>(SudokuTechnique::Search)];
+    result.stats.hits[static_cast<size_t>(SudokuTechnique::Search)] += solved ? 1 : 0;
+    result.stats.search_nodes = search.Nodes();
+    result.stats.search_backtracks = search.Backtracks();
+#endif
+    if (!solved)
+    {
+        return false;
+    }
+    for (int row = 0; row < 9; ++row)
+    {
+        for (int col = 0; col < 9; ++col)
+        {
+            if (m_sudoku->Cell(row, col) == 0)
+            {
+                PutNumber(row, col, search(row, col), SudokuTechnique::Search, result.solution_steps);
+            }
+        }
+    }
+    return true;
+}
@@ -1,34 +1,230 @@
 #ifndef SUDOKU_H
 #define SUDOKU_H
 
+#include <array>
+#include <cassert>
+#include <cstdint>
 #include <iostream>
+#include <string>
+#include <string_view>
 #include <tuple>
 #include <vector>
 
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+
+// Built with SUDOKU_STATS defined, every SudokuResult carries the counters of
+// its solve; without it the counters and the code filling them are compiled out
+#ifdef SUDOKU_STATS
+#define SUDOKU_STAT(...) __VA_ARGS__
+#else
+#define SUDOKU_STAT(...)
+#endif
+
+inline int BitCount(unsigned mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcount(mask);
+#else
+    int count = 0;
+    for (; mask != 0; mask &= mask - 1)
+    {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+inline int LowestBit(unsigned mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(mask);
+#else
+    int index = 0;
+    for (; (mask & 1u) == 0; mask >>= 1)
+    {
+        ++index;
+    }
+    return index;
+#endif
+}
+
+enum class SudokuError : uint8_t
+{
+    None,
+    // number appears twice in a unit
+    Duplicate,
+    // number out of 0..9 in a cell
+    BadValue,
+    NoSolution,
+    // input doesn't have 81 cells
+    WrongSize,
+    // character other than '.' or a digit in a line
+    BadCharacter
+};
+
+const char* ErrorName(SudokuError error);
+
+enum class SudokuUnit : uint8_t
+{
+    None,
+    Row,
+    Col,
+    Square,
+    Cell
+};
+
+// Result of a validity check packed in 4 bytes, the text is only built when
+// asked for
 struct SudokuValid
 {
-    bool is_valid = false;
-    std::string text = std::string("");
+    SudokuError error = SudokuError::None;
+    SudokuUnit unit = SudokuUnit::None;
+    // row, col, index in SudokuGrid::Squares() or row * 9 + col
+    uint8_t index = 0;
+    uint8_t number = 0;
+
+    static SudokuValid Error(SudokuError error, SudokuUnit unit = SudokuUnit::None, int index = 0, int number = 0)
+    {
+        return { error, unit, static_cast<uint8_t>(index), static_cast<uint8_t>(number) };
+    }
 
     operator bool() const
     {
-        return is_valid;
+        return error == SudokuError::None;
     }
+
+    std::string Text() const;
 };
 
+static_assert(sizeof(SudokuValid) == 4, "SudokuValid must stay packed");
+
+// the first error of the two
 SudokuValid operator+(const SudokuValid& lhs, const SudokuValid& rhs);
 
+std::ostream& operator<<(std::ostream& out, const SudokuValid& valid);
+
 // ----------------------------------------------------------------------------
 
+enum class SudokuTechnique
+{
+    // the only place of a number in a square
+    CrossingOut,
+    // the only place of a number in a row or col
+    HiddenSingle,
+    // the only number left for a cell
+    NakedSingle,
+    DoubleGuess,
+    TripleGuess,
+    // candidate eliminations, see SudokuCandidates
+    Pointing,
+    BoxLine,
+    NakedSubset,
+    HiddenSubset,
+    Fish,
+    Coloring,
+    Search,
+    Count
+};
+
+const char* TechniqueName(SudokuTechnique technique);
+
+// What a pass tries, in turn, once the singles stall
+enum class SudokuStage : uint8_t
+{
+    DoubleGuess,
+    TripleGuess,
+    // the SudokuCandidates eliminations
+    Candidates,
+    Count
+};
+
+const char* StageName(SudokuStage stage);
+
+// One placement packed in 4 bytes, the text is only built when asked for
+struct SudokuStep
+{
+    uint8_t number;
+    // row * 9 + col
+    uint8_t cell;
+    // SudokuTechnique
+    uint8_t technique;
+    // solver pass that made the placement, starting from 1
+    uint8_t pass;
+
+    int Row() const
+    {
+        return cell / 9;
+    }
+
+    int Col() const
+    {
+        return cell % 9;
+    }
+
+    SudokuTechnique Technique() const
+    {
+        return static_cast<SudokuTechnique>(technique);
+    }
+
+    std::string Str() const;
+};
+
+static_assert(sizeof(SudokuStep) == 4, "SudokuStep must stay packed");
+
+std::ostream& operator<<(std::ostream& out, const SudokuStep& step);
+
+// What one solve did and where its time went, see SUDOKU_STATS
+struct SudokuStats
+{
+    // solver passes, the search is one more
+    uint32_t passes = 0;
+    // times a SudokuTechnique was looked for, and of those the times it placed
+    // a number or, for the eliminations, removed a candidate
+    std::array<uint32_t, static_cast<size_t>(SudokuTechnique::Count)> calls = {};
+    std::array<uint32_t, static_cast<size_t>(SudokuTechnique::Count)> hits = {};
+    // cells and units looked at for singles
+    uint32_t cells_examined = 0;
+    // numbers the search tried, and of those the ones it took back
+    uint32_t search_nodes = 0;
+    uint32_t search_backtracks = 0;
+    // the validity check and the candidates, the singles of every pass,
+    // every SudokuStage and the search
+    uint64_t setup_ns = 0;
+    uint64_t singles_ns = 0;
+    std::array<uint64_t, static_cast<size_t>(SudokuStage::Count)> stage_ns = {};
+    uint64_t search_ns = 0;
+};
+
+std::ostream& operator<<(std::ostream& out, const SudokuStats& stats);
+
 struct SudokuResult
 {
     SudokuValid valid = SudokuValid();
-    std::vector<std::string> solution_steps;
+    std::vector<SudokuStep> solution_steps;
+    // bit per SudokuTechnique that placed at least one number
+    unsigned techniques = 0;
+#ifdef SUDOKU_STATS
+    SudokuStats stats;
+#endif
 
     SudokuResult() = default;
 
+    // Back to a valid result without steps, keeping the storage
+    void Clear();
     void Print() const;
 
+    void Use(SudokuTechnique technique)
+    {
+        techniques |= 1u << static_cast<unsigned>(technique);
+    }
+
+    bool Used(SudokuTechnique technique) const
+    {
+        return (techniques & (1u << static_cast<unsigned>(technique))) != 0;
+    }
+
     operator bool() const
     {
         return valid;
@@ -56,36 +252,117 @@ struct SudokuSquare
 
 // ----------------------------------------------------------------------------
 
+// Cell indices of the 9 rows, 9 cols and 9 squares (units 0-8, 9-17 and 18-26)
+struct SudokuUnits
+{
+    uint8_t cells[27][9];
+    // the row, col and square of every cell as unit bits
+    uint32_t of[81];
+};
+
+constexpr SudokuUnits CreateSudokuUnits()
+{
+    SudokuUnits units = {};
+    for (int unit = 0; unit < 9; ++unit)
+    {
+        for (int i = 0; i < 9; ++i)
+        {
+            units.cells[unit][i] = static_cast<uint8_t>(unit * 9 + i);
+            units.cells[9 + unit][i] = static_cast<uint8_t>(i * 9 + unit);
+            units.cells[18 + unit][i] = static_cast<uint8_t>((unit / 3 * 3 + i / 3) * 9 + unit % 3 * 3 + i % 3);
+        }
+    }
+    for (int index = 0; index < 81; ++index)
+    {
+        const int row = index / 9;
+        const int col = index % 9;
+        units.of[index] = (1u << row) | (1u << (9 + col)) | (1u << (18 + (row / 3) * 3 + col / 3));
+    }
+    return units;
+}
+
+// ----------------------------------------------------------------------------
+
+// 81 cells stored inline, one byte each; the squares and units geometry is shared
 class SudokuGrid
 {
 public:
+    // empty grid
+    SudokuGrid() = default;
     SudokuGrid(const std::vector<int>& values);
 
-    int& operator()(int row, int col);
-    const int& operator()(int row, int col) const;
+    // Bounds-checked access for callers outside the library
+    uint8_t& operator()(int row, int col);
+    int operator()(int row, int col) const;
+
+    // Unchecked access for the solver and the validator
+    int Cell(int row, int col) const
+    {
+        assert(row >= 0 && row < 9 && col >= 0 && col < 9);
+        return m_sudoku[row * 9 + col];
+    }
+
+    int Cell(int index) const
+    {
+        assert(index >= 0 && index < 81);
+        return m_sudoku[index];
+    }
 
     void FillGrid(const std::vector<int>& values);
 
-    const std::vector<SudokuSquare>& Squares() const {
-        return m_squares;
+    // Non-throwing fills for bulk input, the grid is left unchanged on error
+    SudokuValid TryFillGrid(const std::vector<int>& values);
+    // numbers 0..9, one byte per cell
+    SudokuValid TryFillGrid(const uint8_t* values, size_t size);
+#if __cplusplus >= 202002L
+    SudokuValid TryFillGrid(std::span<const uint8_t> values)
+    {
+        return TryFillGrid(values.data(), values.size());
+    }
+#endif
+    // 81 characters, '.' or '0' mark an empty cell
+    SudokuValid TryFillGrid(std::string_view line);
+
+    static const std::array<SudokuSquare, 9>& Squares() {
+        return SQUARES;
     }
 
-    const std::vector<int>& Values() const {
+    static constexpr const SudokuUnits& Units() {
+        return UNITS;
+    }
+
+    const std::array<uint8_t, 81>& Values() const {
         return m_sudoku;
     }
 
-    std::vector<int> Neighbours(int row_col) const;
+    // the other two rows (cols) of the 3x3 squares grid
+    const std::array<int, 2>& Neighbours(int row_col) const;
+
+protected:
+    uint8_t& MutableCell(int row, int col)
+    {
+        assert(row >= 0 && row < 9 && col >= 0 && col < 9);
+        return m_sudoku[row * 9 + col];
+    }
+
+    void IsRowColValid(int row, int col) const;
 
 private:
     int Index(int row, int col) const;
-    void CreateSquares();
-    void IsRowColValid(int row, int col) const;
 
 private:
-    std::vector<SudokuSquare> m_squares;
-    std::vector<int> m_sudoku;
+    static constexpr std::array<SudokuSquare, 9> SQUARES = { {
+        { 0, 3, 0, 3, 0, 0 }, { 0, 3, 3, 6, 0, 1 }, { 0, 3, 6, 9, 0, 2 },
+        { 3, 6, 0, 3, 1, 0 }, { 3, 6, 3, 6, 1, 1 }, { 3, 6, 6, 9, 1, 2 },
+        { 6, 9, 0, 3, 2, 0 }, { 6, 9, 3, 6, 2, 1 }, { 6, 9, 6, 9, 2, 2 },
+    } };
+    static constexpr SudokuUnits UNITS = CreateSudokuUnits();
+
+    std::array<uint8_t, 81> m_sudoku = {};
 };
 
+static_assert(sizeof(SudokuGrid) == 81, "SudokuGrid must stay a plain array of cells");
+
 bool operator==(const SudokuGrid& lhs, const SudokuGrid& rhs);
 bool operator!=(const SudokuGrid& lhs, const SudokuGrid& rhs);
 
@@ -113,16 +390,54 @@ private:
 class Sudoku : public SudokuGrid
 {
 public:
+    // empty grid
+    Sudoku();
     explicit Sudoku(const std::vector<int>& values);
+    explicit Sudoku(const SudokuGrid& grid);
+
+    // The fills of SudokuGrid followed by a rebuild of the digit masks
+    void FillGrid(const std::vector<int>& values);
+    SudokuValid TryFillGrid(const std::vector<int>& values);
+    SudokuValid TryFillGrid(const uint8_t* values, size_t size);
+#if __cplusplus >= 202002L
+    SudokuValid TryFillGrid(std::span<const uint8_t> values)
+    {
+        return TryFillGrid(values.data(), values.size());
+    }
+#endif
+    SudokuValid TryFillGrid(std::string_view line);
+
+    // Cells must be changed through PutNumber to keep the digit masks in sync
+    int operator()(int row, int col) const
+    {
+        return SudokuGrid::operator()(row, col);
+    }
+
+    void PutNumber(int row, int col, int number);
+    // PutNumber for the solver: the place and the number must be valid
+    void PutNumberUnchecked(int row, int col, int number);
 
+    // O(1) while the grid is consistent, the full check only builds the error text
     SudokuValid IsSudokuValid() const;
 
+    // no number appears twice in a row, col or square
+    bool IsConsistent() const
+    {
+        return m_conflicts == 0;
+    }
+
+    bool IsComplete() const
+    {
+        return m_filled == 81 && IsConsistent();
+    }
+
     bool HasRowNumber(int row, int number) const;
     bool HasColNumber(int col, int number) const;
     bool HasSquareNumber(const SudokuSquare& square, int number) const;
 
-    std::vector<int> AvailableRows(int number, const SudokuSquare& square) const;
-    std::vector<int> AvailableCols(int number, const SudokuSquare& square) const;
+    // bit row (col) is set when the number can still be put in that row (col) of the square
+    uint16_t AvailableRows(int number, const SudokuSquare& square) const;
+    uint16_t AvailableCols(int number, const SudokuSquare& square) const;
 
     struct SudokuFoundPlace
     {
@@ -141,37 +456,291 @@ public:
     Sudoku::SudokuFoundPlace SearchUsingTripleGuess(const SudokuSquare& square, int number);
 
 private:
-    Sudoku() = default;
+    static uint16_t NumberBit(int number)
+    {
+        return static_cast<uint16_t>(1u << (number - 1));
+    }
+
+    static uint16_t SquareColsMask(const SudokuSquare& square)
+    {
+        return static_cast<uint16_t>(0b111u << square.col_begin);
+    }
+
+    static int SquareIndex(int row, int col)
+    {
+        return (row / 3) * 3 + col / 3;
+    }
+
+    // The only line (row or col) of the square left for the number once the
+    // lines taken by the two neighbour squares are excluded, 0 if not unique
+    static uint16_t SingleLine(uint16_t available_0, uint16_t available_1, uint16_t available_2);
+
+    void CreateMasks();
+    void AddToMasks(int row, int col, int number);
+    // Recomputes the masks of the row, col and square of the cell after a number was changed or erased
+    void RescanUnits(int row, int col);
+
+private:
+    // bit (number - 1) is set when the unit already contains the number
+    std::array<uint16_t, 9> m_row_numbers = {};
+    std::array<uint16_t, 9> m_col_numbers = {};
+    std::array<uint16_t, 9> m_square_numbers = {};
+
+    // indexed by (number - 1): bit col is set when the number is placed in the col
+    std::array<uint16_t, 9> m_number_cols = {};
+
+    // bit col is set when the cell (row, col) is empty
+    std::array<uint16_t, 9> m_row_empty = {};
+
+    // units with a repeated number: bits [0, 9) rows, [9, 18) cols, [18, 27) squares
+    uint32_t m_conflicts = 0;
+    uint8_t m_filled = 0;
+};
+
+// ----------------------------------------------------------------------------
+
+// Depth-first search used once the logical techniques stall.
+// Picks the cell with the minimum remaining values, keeps the candidates as
+// bitmasks and backtracks with a fixed-size explicit stack (no recursion and
+// no heap allocation).
+class SudokuSearch
+{
+public:
+    explicit SudokuSearch(const SudokuGrid& grid);
+
+    bool Run();
+
+    int operator()(int row, int col) const
+    {
+        return m_cells[row * 9 + col];
+    }
+
+#ifdef SUDOKU_STATS
+    uint32_t Nodes() const
+    {
+        return m_nodes;
+    }
+
+    uint32_t Backtracks() const
+    {
+        return m_backtracks;
+    }
+#endif
+
+private:
+    struct SudokuSearchFrame
+    {
+        uint8_t cell;
+        uint16_t candidates;
+    };
+
+    bool SelectCell(int& cell, uint16_t& candidates) const;
+    void Put(int cell, int number);
+    void Clear(int cell);
+
+private:
+    std::array<uint8_t, 81> m_cells = {};
+    std::array<uint16_t, 9> m_rows = {};
+    std::array<uint16_t, 9> m_cols = {};
+    std::array<uint16_t, 9> m_squares = {};
+    std::array<SudokuSearchFrame, 81> m_stack = {};
+#ifdef SUDOKU_STATS
+    uint32_t m_nodes = 0;
+    uint32_t m_backtracks = 0;
+#endif
 };
 
 // ----------------------------------------------------------------------------
 
+// Candidates of every empty cell as a mask with bit (number - 1), kept in sync
+// with the placements and stored by number as well. Every change marks the
+// cell, and the units of the cell for the numbers it lost, so singles are
+// only looked for where something changed. The places of a number in a unit
+// (row, col or square) are a 9-bit mask, so the eliminations test whole
+// units with masks and popcounts: a pair, triple or quad is one of the
+// subset masks of the unit. A reduction looks again only at the units (the
+// numbers, for the fish and the coloring) that lost a candidate since it
+// last ran, so retrying the reductions after each other's removals is cheap.
+// Units are numbered rows [0, 9), cols [9, 18), squares [18, 27); a position
+// in a square is row * 3 + col inside it.
+class SudokuCandidates
+{
+public:
+    SudokuCandidates() = default;
+    explicit SudokuCandidates(const SudokuGrid& grid);
+
+    // Rebuilds the candidates of another grid in place
+    void Reset(const SudokuGrid& grid);
+
+    uint16_t Cell(int index) const
+    {
+        return m_cells[index];
+    }
+
+    // the cell is filled, the number leaves its row, col and square
+    void Place(int index, int number);
+
+    // Every reduction returns true when it removed at least one candidate.
+    // A number confined to one line of a square leaves the rest of the line
+    // (pointing pairs and triples).
+    bool ReducePointing();
+    // A number confined to one square in a line leaves the rest of the square
+    bool ReduceBoxLine();
+    // k cells of a unit with only k numbers between them, k = 2..4, take these
+    // numbers from the other cells of the unit
+    bool ReduceNakedSubsets();
+    // k numbers of a unit confined to k cells, k = 2..4, leave no room for
+    // other numbers in these cells
+    bool ReduceHiddenSubsets();
+    // k rows with the places of a number inside k cols, k = 2..4 (X-Wing,
+    // Swordfish, Jellyfish), clear the number from these cols in the other
+    // rows; the same with rows and cols swapped
+    bool ReduceFish();
+    // Simple coloring: the cells of a number linked by units with exactly two
+    // places alternate between true and false. A color with two cells in a
+    // unit is false, a cell that sees both colors can't hold the number.
+    bool ReduceColoring();
+
+    struct SudokuSingle
+    {
+        uint8_t cell;
+        uint8_t number;
+        // CrossingOut, HiddenSingle or NakedSingle
+        SudokuTechnique technique;
+    };
+
+    // Singles that may have appeared since the last call, one technique at a
+    // time: squares with one place left for a number (CrossingOut), else
+    // rows and cols (HiddenSingle), else cells with one candidate
+    // (NakedSingle). Only the units where a number lost a place and the
+    // changed cells are looked at; what was looked at is consumed. A cell may
+    // be listed more than once. Returns the count written to singles.
+    size_t TakeSingles(std::array<SudokuSingle, 81 * 2>& singles);
+
+#ifdef SUDOKU_STATS
+    // cells and units TakeSingles looked at
+    uint32_t Examined() const
+    {
+        return m_examined;
+    }
+#endif
+
+private:
+    enum SudokuReduction
+    {
+        POINTING,
+        BOX_LINE,
+        NAKED_SUBSETS,
+        HIDDEN_SUBSETS,
+        FISH,
+        COLORING,
+        REDUCTIONS
+    };
+
+    // bits [0, 27) for the units, [32, 41) for the numbers
+    static constexpr uint64_t ALL_CHANGED = ((1ull << 27) - 1) | (0x1FFull << 32);
+
+    // what changed since the reduction last ran, which it now consumes
+    uint64_t TakeStale(SudokuReduction reduction);
+    // positions[number - 1] is the mask of the unit positions open to the number
+    void Positions(int unit, std::array<uint16_t, 9>& positions) const;
+    // the unit positions open to number - 1
+    uint16_t Places(int unit, int number) const;
+    bool Remove(int unit, uint16_t positions, uint16_t numbers);
+    // the numbers leave one cell
+    void Clear(int index, uint16_t numbers);
+    // the cell, and the units of the cell for the numbers, are checked by the next TakeSingles
+    void Touch(int index, uint16_t numbers);
+
+private:
+    std::array<uint16_t, 81> m_cells = {};
+    // the same candidates as a bitboard per number: [number - 1][row] has bit
+    // col set when the number can go to (row, col), m_cols is the transpose
+    std::array<std::array<uint16_t, 9>, 9> m_rows = {};
+    std::array<std::array<uint16_t, 9>, 9> m_cols = {};
+
+    // changed since the last TakeSingles: bit col of [row] for the cells,
+    // bit unit of [number - 1] for the units where the number lost a place
+    std::array<uint16_t, 9> m_dirty_cells = {};
+    std::array<uint32_t, 9> m_dirty_units = {};
+    // the units and numbers that lost a candidate, not yet handed to the
+    // reductions, and per reduction the ones it has still to look at
+    uint64_t m_changed = 0;
+    std::array<uint64_t, REDUCTIONS> m_stale = {};
+#ifdef SUDOKU_STATS
+    uint32_t m_examined = 0;
+#endif
+};
+
+// ----------------------------------------------------------------------------
+
+// Placements per number kept in buckets: bucket count has bit (number - 1)
+// set for the numbers placed count times. Increments move a bit between two
+// buckets, the order of a pass is read from the buckets without sorting and
+// the numbers placed 9 times sit in the last bucket, out of the order. The
+// storage is fixed, Reset reuses it for another puzzle.
 class SudokuPopularity
 {
 public:
-    SudokuPopularity(const Sudoku& sudoku);
+    SudokuPopularity() = default;
+    explicit SudokuPopularity(const Sudoku& sudoku);
+
+    void Reset(const Sudoku& sudoku);
 
+    // Snapshot of the order for the next pass: the most placed numbers
+    // first, ties by number, completed numbers left out. Later increments
+    // don't reorder the snapshot.
     void SortPopularity();
-    void ErasePopularity();
     void IncreasePolularity(int number);
 
+    // every number is placed 9 times
     bool IsEmpty() const
     {
-        return m_number_popularity.empty();
+        return m_buckets[9] == 0x1FF;
     }
 
-    const auto begin() const
+    // (number, popularity) pairs of the last snapshot
+    const std::pair<int, int>* begin() const
     {
-        return m_number_popularity.begin();
+        return m_order.data();
     }
 
-    const auto end() const
+    const std::pair<int, int>* end() const
     {
-        return m_number_popularity.end();
+        return m_order.data() + m_order_size;
     }
 
 private:
-    std::vector<std::pair<int, int>> m_number_popularity;
+    std::array<uint8_t, 9> m_counts = {};
+    std::array<uint16_t, 10> m_buckets = {};
+    std::array<std::pair<int, int>, 9> m_order = {};
+    size_t m_order_size = 0;
+};
+
+// ----------------------------------------------------------------------------
+
+class SudokuMetrics;
+class SudokuTracer;
+class SudokuTraceRing;
+
+// Orders the stages of a pass and hears how each run went. One strategy may
+// be shared by solvers on several threads.
+class SudokuStrategy
+{
+public:
+    using SudokuStageOrder = std::array<SudokuStage, static_cast<size_t>(SudokuStage::Count)>;
+
+    // double guess, triple guess, candidates
+    static constexpr SudokuStageOrder FIXED_ORDER = {
+        SudokuStage::DoubleGuess, SudokuStage::TripleGuess, SudokuStage::Candidates
+    };
+
+    virtual ~SudokuStrategy() = default;
+
+    // order holds FIXED_ORDER on the call
+    virtual void Order(SudokuStageOrder& order) = 0;
+    // the stage ran for nanoseconds and placed numbers or not
+    virtual void Report(SudokuStage stage, uint64_t nanoseconds, bool placed) = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -179,19 +748,80 @@ private:
 class SudokuSolver
 {
 public:
+    // Reset binds a solver made without a sudoku before it solves
+    SudokuSolver() = default;
     SudokuSolver(Sudoku& sudoku);
 
+    // Solves another sudoku from now on, keeping the settings and the storage
+    void Reset(Sudoku& sudoku)
+    {
+        m_sudoku = &sudoku;
+    }
+
     SudokuResult Solve();
+    // Reuses the storage of the result, so solving allocates nothing
+    // once the result has seen a full solve
+    void Solve(SudokuResult& result);
 
-private:
-    bool SolveCrossingOut(int number, std::vector<std::string>& solutions);
-    bool SolveDoubleGuess(int number, std::vector<std::string>& solutions);
-    bool SolveTripleGuess(int number, std::vector<std::string>& solutions);
+    // The stages run in the order of the strategy and are timed for it
+    // while it is set, nullptr keeps SudokuStrategy::FIXED_ORDER
+    void SetStrategy(SudokuStrategy* strategy)
+    {
+        m_strategy = strategy;
+    }
+
+    // The validity check before a solve is timed into the metrics while
+    // they are set
+    void SetMetrics(SudokuMetrics* metrics)
+    {
+        m_metrics = metrics;
+    }
 
+    // The solves the tracer samples are traced pass by pass while it is set
+    void SetTracer(SudokuTracer* tracer)
+    {
+        m_tracer = tracer;
+    }
+
+    // While rating, a stall runs the subset, fish and coloring reductions
+    // before the search, so the steps name the technique a person would use
+    void SetRating(bool rating)
+    {
+        m_rating = rating;
+    }
+
+private:
+    void PutNumber(int row, int col, int number, SudokuTechnique technique, std::vector<SudokuStep>& solutions);
+
+    // Places the singles the last changes left, one technique per pass:
+    // hidden singles in squares, else in rows and cols, else naked singles.
+    // Until the first stall only the squares are swept on the digit masks,
+    // the candidates are built then, so puzzles that crossing out finishes
+    // never pay for them.
+    bool SolveSingles(SudokuResult& result);
+    bool SolveCrossingOut(int number, SudokuResult& result);
+    bool SolveStage(SudokuStage stage, SudokuResult& result);
+    bool SolveDoubleGuess(int number, std::vector<SudokuStep>& solutions);
+    bool SolveTripleGuess(int number, std::vector<SudokuStep>& solutions);
+    // Eliminations on the candidates until they leave a single to place,
+    // the cheapest reductions are retried first; pointing and box-line only
+    // unless rating
+    bool SolveCandidates(SudokuResult& result);
+    bool SolveSearch(SudokuResult& result);
 
 private:
-    Sudoku& m_sudoku;
+    Sudoku* m_sudoku = nullptr;
     SudokuPopularity m_popularity;
+    SudokuCandidates m_candidates;
+    // m_candidates is built and kept in sync with the placements
+    bool m_has_candidates = false;
+    SudokuStrategy* m_strategy = nullptr;
+    SudokuMetrics* m_metrics = nullptr;
+    SudokuTracer* m_tracer = nullptr;
+    // ring of the solve being traced, nullptr when it isn't
+    SudokuTraceRing* m_trace = nullptr;
+    bool m_rating = false;
+    int m_pass = 0;
 };
 
 #endif // SUDOKU_H
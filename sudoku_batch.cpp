@@ -0,0 +1,167 @@
+#include "sudoku_batch.h"
+
+#include "sudoku_metrics.h"
+
+#include <algorithm>
+#include <chrono>
+
+SudokuBatchSolver::SudokuBatchSolver(size_t thread_count)
+    : m_worker_count(std::max<size_t>(thread_count, 1)),
+      m_ranges(new SudokuWorkRange[m_worker_count])
+{
+    // worker 0 is the thread that calls Solve
+    for (size_t worker = 1; worker < m_worker_count; ++worker)
+    {
+        m_threads.emplace_back(&SudokuBatchSolver::WorkerLoop, this, worker);
+    }
+}
+
+SudokuBatchSolver::~SudokuBatchSolver()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_start.notify_all();
+    for (std::thread& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+std::vector<SudokuResult> SudokuBatchSolver::Solve(std::vector<Sudoku>& sudokus)
+{
+    std::vector<SudokuResult> results(sudokus.size());
+    Solve(sudokus.data(), results.data(), sudokus.size());
+    return results;
+}
+
+void SudokuBatchSolver::Solve(Sudoku* sudokus, SudokuResult* results, size_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    m_sudokus = sudokus;
+    m_results = results;
+    for (size_t worker = 0; worker < m_worker_count; ++worker)
+    {
+        SudokuWorkRange& range = m_ranges[worker];
+        std::lock_guard<std::mutex> lock(range.mutex);
+        range.begin = count * worker / m_worker_count;
+        range.end = count * (worker + 1) / m_worker_count;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_active = m_worker_count - 1;
+        ++m_generation;
+    }
+    m_start.notify_all();
+
+    RunWorker(0, m_solver);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() { return m_active == 0; });
+}
+
+void SudokuBatchSolver::WorkerLoop(size_t worker)
+{
+    SudokuSolver solver;
+    size_t generation = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_start.wait(lock, [this, generation]() { return m_stop || m_generation != generation; });
+            if (m_stop)
+            {
+                return;
+            }
+            generation = m_generation;
+        }
+
+        RunWorker(worker, solver);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_active;
+        }
+        m_done.notify_one();
+    }
+}
+
+void SudokuBatchSolver::RunWorker(size_t worker, SudokuSolver& solver)
+{
+    solver.SetStrategy(m_strategy);
+    solver.SetMetrics(m_metrics);
+    solver.SetTracer(m_tracer);
+    solver.SetRating(m_rating);
+    size_t begin = 0;
+    size_t end = 0;
+    while (TakeOwn(worker, begin, end) || (Steal(worker) && TakeOwn(worker, begin, end)))
+    {
+        for (size_t index = begin; index < end; ++index)
+        {
+            using Clock = std::chrono::steady_clock;
+            const Clock::time_point start = m_metrics != nullptr ? Clock::now() : Clock::time_point();
+            if (m_cache != nullptr)
+            {
+                m_cache->Solve(m_sudokus[index], m_results[index], m_strategy, m_metrics, m_tracer);
+            }
+            else
+            {
+                solver.Reset(m_sudokus[index]);
+                solver.Solve(m_results[index]);
+            }
+            if (m_metrics != nullptr)
+            {
+                const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+                m_metrics->RecordSolve(m_results[index], static_cast<uint64_t>(elapsed.count()));
+            }
+        }
+    }
+}
+
+bool SudokuBatchSolver::TakeOwn(size_t worker, size_t& begin, size_t& end)
+{
+    SudokuWorkRange& range = m_ranges[worker];
+    std::lock_guard<std::mutex> lock(range.mutex);
+    if (range.begin == range.end)
+    {
+        return false;
+    }
+    // small chunks keep most of the range available for thieves
+    const size_t chunk = std::clamp<size_t>((range.end - range.begin) / 16, 1, 32);
+    begin = range.begin;
+    end = begin + chunk;
+    range.begin = end;
+    return true;
+}
+
+bool SudokuBatchSolver::Steal(size_t worker)
+{
+    for (size_t offset = 1; offset < m_worker_count; ++offset)
+    {
+        SudokuWorkRange& victim = m_ranges[(worker + offset) % m_worker_count];
+        size_t begin = 0;
+        size_t end = 0;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.begin == victim.end)
+            {
+                continue;
+            }
+            begin = victim.begin + (victim.end - victim.begin) / 2;
+            end = victim.end;
+            victim.end = begin;
+        }
+        SudokuWorkRange& own = m_ranges[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.begin = begin;
+        own.end = end;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,104 @@
+#ifndef SUDOKU_BATCH_H
+#define SUDOKU_BATCH_H
+
+#include "sudoku.h"
+#include "sudoku_cache.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Solves many independent sudokus on a persistent thread pool.
+// Each worker owns a contiguous range of puzzles and takes small chunks from
+// its front; an idle worker steals the back half of another worker's range,
+// so a few expensive puzzles do not leave the other cores idle.
+class SudokuBatchSolver
+{
+public:
+    explicit SudokuBatchSolver(size_t thread_count = std::thread::hardware_concurrency());
+    ~SudokuBatchSolver();
+
+    SudokuBatchSolver(const SudokuBatchSolver&) = delete;
+    SudokuBatchSolver& operator=(const SudokuBatchSolver&) = delete;
+
+    // Sudokus are solved in place, results[i] belongs to sudokus[i]
+    std::vector<SudokuResult> Solve(std::vector<Sudoku>& sudokus);
+    void Solve(Sudoku* sudokus, SudokuResult* results, size_t count);
+
+    // Puzzles are solved through the cache while it is set, nullptr turns it off
+    void SetCache(SudokuSolutionCache* cache)
+    {
+        m_cache = cache;
+    }
+
+    // Every solver of the batch runs with the strategy while it is set
+    void SetStrategy(SudokuStrategy* strategy)
+    {
+        m_strategy = strategy;
+    }
+
+    // Every solve, through the cache or not, is timed into the metrics while
+    // they are set
+    void SetMetrics(SudokuMetrics* metrics)
+    {
+        m_metrics = metrics;
+    }
+
+    // Every solver of the batch samples its solves into the tracer while it is set
+    void SetTracer(SudokuTracer* tracer)
+    {
+        m_tracer = tracer;
+    }
+
+    // Every solver of the batch solves for a rating, see SudokuSolver::SetRating
+    void SetRating(bool rating)
+    {
+        m_rating = rating;
+    }
+
+    size_t ThreadCount() const
+    {
+        return m_worker_count;
+    }
+
+private:
+    struct SudokuWorkRange
+    {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    void WorkerLoop(size_t worker);
+    // the solver of the worker is kept across batches and rebound to every puzzle
+    void RunWorker(size_t worker, SudokuSolver& solver);
+    bool TakeOwn(size_t worker, size_t& begin, size_t& end);
+    bool Steal(size_t worker);
+
+private:
+    size_t m_worker_count;
+    std::unique_ptr<SudokuWorkRange[]> m_ranges;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    size_t m_generation = 0;
+    size_t m_active = 0;
+    bool m_stop = false;
+
+    Sudoku* m_sudokus = nullptr;
+    SudokuResult* m_results = nullptr;
+    SudokuSolutionCache* m_cache = nullptr;
+    SudokuStrategy* m_strategy = nullptr;
+    SudokuMetrics* m_metrics = nullptr;
+    SudokuTracer* m_tracer = nullptr;
+    bool m_rating = false;
+    // the solver of worker 0, the thread that calls Solve
+    SudokuSolver m_solver;
+};
+
+#endif // SUDOKU_BATCH_H
@@ -0,0 +1,699 @@
+#include "sudoku_bench.h"
+
+#include "sudoku.h"
+#include "sudoku_cache.h"
+#include "sudoku_rating.h"
+#include "sudoku_stream.h"
+#include "sudoku_test.h"
+#include "sudoku_validity.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__linux__)
+#define SUDOKU_HAS_PERF_EVENTS 1
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace std::string_literals;
+
+namespace
+{
+#ifdef SUDOKU_COUNT_ALLOCATIONS
+thread_local size_t allocation_count = 0;
+
+void* CountedAllocate(size_t size)
+{
+    ++allocation_count;
+    return std::malloc(size == 0 ? 1 : size);
+}
+#endif
+
+double Percentile(const std::vector<long long>& sorted, double percentile)
+{
+    if (sorted.empty())
+    {
+        return 0.0;
+    }
+    const size_t index = static_cast<size_t>(percentile / 100.0 * static_cast<double>(sorted.size() - 1) + 0.5);
+    return static_cast<double>(sorted[std::min(index, sorted.size() - 1)]);
+}
+
+// Cycles and instructions of the calling thread in user space
+class SudokuPerfCounters
+{
+public:
+    SudokuPerfCounters()
+    {
+#ifdef SUDOKU_HAS_PERF_EVENTS
+        m_cycles_fd = Open(PERF_COUNT_HW_CPU_CYCLES);
+        m_instructions_fd = Open(PERF_COUNT_HW_INSTRUCTIONS);
+#endif
+    }
+
+    ~SudokuPerfCounters()
+    {
+#ifdef SUDOKU_HAS_PERF_EVENTS
+        if (m_cycles_fd >= 0)
+        {
+            close(m_cycles_fd);
+        }
+        if (m_instructions_fd >= 0)
+        {
+            close(m_instructions_fd);
+        }
+#endif
+    }
+
+    SudokuPerfCounters(const SudokuPerfCounters&) = delete;
+    SudokuPerfCounters& operator=(const SudokuPerfCounters&) = delete;
+
+    const char* Source() const
+    {
+        if (m_cycles_fd >= 0)
+        {
+            return "perf";
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        return "tsc";
+#else
+        return "none";
+#endif
+    }
+
+    bool HasCycles() const
+    {
+        return std::strcmp(Source(), "none") != 0;
+    }
+
+    bool HasInstructions() const
+    {
+        return m_instructions_fd >= 0;
+    }
+
+    void Start()
+    {
+#ifdef SUDOKU_HAS_PERF_EVENTS
+        Enable(m_cycles_fd, true);
+        Enable(m_instructions_fd, true);
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+        m_tsc_start = __rdtsc();
+#endif
+    }
+
+    void Stop()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        m_tsc += __rdtsc() - m_tsc_start;
+#endif
+#ifdef SUDOKU_HAS_PERF_EVENTS
+        Enable(m_instructions_fd, false);
+        Enable(m_cycles_fd, false);
+#endif
+    }
+
+    uint64_t Cycles() const
+    {
+        return m_cycles_fd >= 0 ? Read(m_cycles_fd) : m_tsc;
+    }
+
+    uint64_t Instructions() const
+    {
+        return Read(m_instructions_fd);
+    }
+
+private:
+#ifdef SUDOKU_HAS_PERF_EVENTS
+    static int Open(uint64_t config)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    static void Enable(int fd, bool enable)
+    {
+        if (fd >= 0)
+        {
+            ioctl(fd, enable ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+#endif
+
+    static uint64_t Read(int fd)
+    {
+        uint64_t value = 0;
+#ifdef SUDOKU_HAS_PERF_EVENTS
+        if (fd >= 0 && read(fd, &value, sizeof(value)) != static_cast<ssize_t>(sizeof(value)))
+        {
+            value = 0;
+        }
+#else
+        (void)fd;
+#endif
+        return value;
+    }
+
+private:
+    int m_cycles_fd = -1;
+    int m_instructions_fd = -1;
+    uint64_t m_tsc_start = 0;
+    uint64_t m_tsc = 0;
+};
+
+// Keeps the results of the measured kernels alive
+volatile size_t kernel_sink = 0;
+}
+
+// Built with SUDOKU_COUNT_ALLOCATIONS, every heap allocation of the process
+// costs a thread-local increment. All the unaligned forms are replaced
+// together so that each new meets its own delete; the aligned forms keep the
+// allocator of the library and are not counted.
+#ifdef SUDOKU_COUNT_ALLOCATIONS
+void* operator new(size_t size)
+{
+    if (void* ptr = CountedAllocate(size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    if (void* ptr = CountedAllocate(size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return CountedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return CountedAllocate(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+#endif
+
+// ----------------------------------------------------------------------------
+
+SudokuBench::SudokuBench(size_t repeat) : m_repeat(std::max<size_t>(repeat, 1))
+{
+}
+
+void SudokuBench::AddDataset(const std::string& name, std::vector<SudokuInput> puzzles)
+{
+    m_datasets.push_back({ name, std::move(puzzles) });
+}
+
+void SudokuBench::AddEmbeddedDatasets()
+{
+    const std::pair<std::string, const SudokuTest::SudokuTestData*> embedded[] = {
+        { "easy"s, &SudokuTest::DataEasy() },
+        { "medium"s, &SudokuTest::DataMedium() },
+        { "hard"s, &SudokuTest::DataHard() },
+        { "extream"s, &SudokuTest::DataExtream() },
+    };
+    for (const auto& [name, data] : embedded)
+    {
+        std::vector<SudokuInput> puzzles;
+        for (const auto& [input, solved] : *data)
+        {
+            puzzles.push_back(input);
+        }
+        AddDataset(name, std::move(puzzles));
+    }
+}
+
+void SudokuBench::AddFile(const std::string& path)
+{
+    SudokuLineReader reader(path);
+    std::vector<SudokuInput> puzzles;
+    SudokuGrid grid;
+    std::string_view line;
+    while (reader.NextLine(line))
+    {
+        if (grid.TryFillGrid(line))
+        {
+            puzzles.emplace_back(grid.Values().begin(), grid.Values().end());
+        }
+    }
+    AddDataset(path, std::move(puzzles));
+}
+
+void SudokuBench::Run(std::ostream& out) const
+{
+    out << "{\n  \"benchmark\": \"solve\",\n  \"repeat\": "s << m_repeat << ",\n  \"datasets\": ["s;
+    for (size_t i = 0; i < m_datasets.size(); ++i)
+    {
+        out << (i == 0 ? "\n"s : ",\n"s);
+        RunDataset(m_datasets[i], out);
+    }
+    out << "\n  ]\n}"s << std::endl;
+}
+
+size_t SudokuBench::Allocations()
+{
+#ifdef SUDOKU_COUNT_ALLOCATIONS
+    return allocation_count;
+#else
+    return 0;
+#endif
+}
+
+bool SudokuBench::CountsAllocations()
+{
+#ifdef SUDOKU_COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void SudokuBench::RunDataset(const SudokuBenchDataset& dataset, std::ostream& out) const
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<long long> latencies;
+    latencies.reserve(dataset.puzzles.size() * m_repeat);
+    std::array<size_t, static_cast<size_t>(SudokuTechnique::Count)> technique_puzzles = {};
+    std::array<size_t, SudokuRater::TIER_LIMITS.size() + 1> tier_puzzles = {};
+    double score = 0.0;
+    size_t failed = 0;
+    size_t allocations = 0;
+
+    std::vector<Sudoku> sudokus;
+    sudokus.reserve(dataset.puzzles.size());
+    for (const SudokuInput& puzzle : dataset.puzzles)
+    {
+        sudokus.emplace_back(puzzle);
+    }
+
+    SudokuResult result;
+    for (size_t pass = 0; pass < m_repeat; ++pass)
+    {
+        for (size_t i = 0; i < sudokus.size(); ++i)
+        {
+            Sudoku sudoku = sudokus[i];
+            const Clock::time_point start = Clock::now();
+
+            SudokuSolver solver(sudoku);
+            // the solver setup is timed but only the solve loop is checked for allocations
+            const size_t allocations_before = Allocations();
+            solver.Solve(result);
+            allocations += Allocations() - allocations_before;
+
+            const Clock::time_point finish = Clock::now();
+            latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count());
+
+            if (pass != 0)
+            {
+                continue;
+            }
+            if (!result)
+            {
+                ++failed;
+            }
+            for (size_t technique = 0; technique < technique_puzzles.size(); ++technique)
+            {
+                if (result.Used(static_cast<SudokuTechnique>(technique)))
+                {
+                    ++technique_puzzles[technique];
+                }
+            }
+            const SudokuRating rating = SudokuRater::Rate(result);
+            ++tier_puzzles[static_cast<size_t>(rating.tier)];
+            score += rating.score;
+        }
+    }
+
+    long long total = 0;
+    for (long long latency : latencies)
+    {
+        total += latency;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    const double solves = static_cast<double>(std::max<size_t>(latencies.size(), 1));
+    const double puzzles = static_cast<double>(std::max<size_t>(dataset.puzzles.size(), 1));
+
+    out << "    {\n      \"name\": \""s << dataset.name << "\",\n"s
+        << "      \"puzzles\": "s << dataset.puzzles.size() << ",\n"s
+        << "      \"solves\": "s << latencies.size() << ",\n"s
+        << "      \"failed\": "s << failed << ",\n"s
+        << "      \"puzzles_per_sec\": "s << (total > 0 ? solves * 1e9 / static_cast<double>(total) : 0.0) << ",\n"s
+        << "      \"latency_ns\": { \"mean\": "s << static_cast<double>(total) / solves
+        << ", \"p50\": "s << Percentile(latencies, 50.0)
+        << ", \"p99\": "s << Percentile(latencies, 99.0)
+        << ", \"p99.9\": "s << Percentile(latencies, 99.9)
+        << ", \"max\": "s << (latencies.empty() ? 0 : latencies.back()) << " },\n"s
+        << "      \"allocations_per_solve\": "s;
+    if (CountsAllocations())
+    {
+        out << static_cast<double>(allocations) / solves;
+    }
+    else
+    {
+        out << "null"s;
+    }
+    out << ",\n"s
+        << "      \"technique_share\": {"s;
+    for (size_t technique = 0; technique < technique_puzzles.size(); ++technique)
+    {
+        out << (technique == 0 ? " "s : ", "s) << "\""s << TechniqueName(static_cast<SudokuTechnique>(technique))
+            << "\": "s << static_cast<double>(technique_puzzles[technique]) / puzzles;
+    }
+    out << " },\n"s
+        << "      \"mean_score\": "s << score / puzzles << ",\n"s
+        << "      \"tier_share\": {"s;
+    for (size_t tier = 0; tier < tier_puzzles.size(); ++tier)
+    {
+        out << (tier == 0 ? " "s : ", "s) << "\""s << TierName(static_cast<SudokuTier>(tier))
+            << "\": "s << static_cast<double>(tier_puzzles[tier]) / puzzles;
+    }
+    out << " }\n    }"s;
+}
+
+// ----------------------------------------------------------------------------
+
+SudokuMicroBench::SudokuMicroBench(size_t min_ops) : m_min_ops(std::max<size_t>(min_ops, 1))
+{
+}
+
+void SudokuMicroBench::CaptureStates(const std::vector<SudokuInput>& puzzles)
+{
+    for (const SudokuInput& puzzle : puzzles)
+    {
+        Sudoku sudoku(puzzle);
+        SudokuSolver solver(sudoku);
+        const SudokuResult result = solver.Solve();
+        if (!result)
+        {
+            continue;
+        }
+
+        SudokuInput state = puzzle;
+        const size_t steps = result.solution_steps.size();
+        for (size_t step = 0, quarter = 0; step < steps; ++step)
+        {
+            if (step == quarter * steps / 4)
+            {
+                m_states.push_back(state);
+                ++quarter;
+            }
+            const SudokuStep& solution_step = result.solution_steps[step];
+            state[solution_step.cell] = solution_step.number;
+        }
+    }
+}
+
+void SudokuMicroBench::Run(std::ostream& out) const
+{
+    std::vector<Sudoku> sudokus;
+    for (const SudokuInput& state : m_states)
+    {
+        sudokus.emplace_back(state);
+    }
+    const size_t states = sudokus.size();
+    const auto no_setup = []() {};
+
+    // the search kernels are only called for the squares that miss the number
+    std::vector<std::pair<size_t, std::pair<const SudokuSquare*, int>>> open_places;
+    for (size_t i = 0; i < states; ++i)
+    {
+        for (const SudokuSquare& square : sudokus[i].Squares())
+        {
+            for (int number = 1; number <= 9; ++number)
+            {
+                if (!sudokus[i].HasSquareNumber(square, number))
+                {
+                    open_places.push_back({ i, { &square, number } });
+                }
+            }
+        }
+    }
+
+    SudokuPerfCounters counters;
+    out << "{\n  \"benchmark\": \"kernels\",\n  \"states\": "s << states << ",\n  \"counters\": \""s
+        << counters.Source() << "\",\n  \"kernels\": [\n"s;
+
+    Measure("SudokuCheckValidity::IsSudokuValid"s, states, no_setup, [&]() {
+        for (const Sudoku& sudoku : sudokus)
+        {
+            kernel_sink = kernel_sink + static_cast<bool>(SudokuCheckValidity::IsSudokuValid(sudoku));
+        }
+    }, out);
+    out << ",\n"s;
+
+    // the grids of the states side by side, as the batch kernel reads them
+    const std::vector<SudokuGrid> grids(sudokus.begin(), sudokus.end());
+    std::vector<SudokuGridStatus> statuses(states);
+    Measure("SudokuBatchValidity::Validate"s, states, no_setup, [&]() {
+        if (states != 0)
+        {
+            SudokuBatchValidity::Validate(grids.data(), grids.size(), statuses.data());
+            kernel_sink = kernel_sink + static_cast<size_t>(statuses.back());
+        }
+    }, out);
+    out << ",\n"s;
+
+    Measure("Sudoku::AvailableRows"s, states * 81, no_setup, [&]() {
+        for (const Sudoku& sudoku : sudokus)
+        {
+            for (const SudokuSquare& square : sudoku.Squares())
+            {
+                for (int number = 1; number <= 9; ++number)
+                {
+                    kernel_sink = kernel_sink + BitCount(sudoku.AvailableRows(number, square));
+                }
+            }
+        }
+    }, out);
+    out << ",\n"s;
+
+    Measure("Sudoku::AvailableCols"s, states * 81, no_setup, [&]() {
+        for (const Sudoku& sudoku : sudokus)
+        {
+            for (const SudokuSquare& square : sudoku.Squares())
+            {
+                for (int number = 1; number <= 9; ++number)
+                {
+                    kernel_sink = kernel_sink + BitCount(sudoku.AvailableCols(number, square));
+                }
+            }
+        }
+    }, out);
+    out << ",\n"s;
+
+    Measure("Sudoku::SearchUsingCrossingOut"s, open_places.size(), no_setup, [&]() {
+        for (const auto& [index, place] : open_places)
+        {
+            kernel_sink = kernel_sink + sudokus[index].SearchUsingCrossingOut(*place.first, place.second).was_found;
+        }
+    }, out);
+    out << ",\n"s;
+
+    Measure("Sudoku::SearchUsingDoubleGuess"s, open_places.size(), no_setup, [&]() {
+        for (const auto& [index, place] : open_places)
+        {
+            kernel_sink = kernel_sink + sudokus[index].SearchUsingDoubleGuess(*place.first, place.second).was_found;
+        }
+    }, out);
+    out << ",\n"s;
+
+    Measure("Sudoku::SearchUsingTripleGuess"s, open_places.size(), no_setup, [&]() {
+        for (const auto& [index, place] : open_places)
+        {
+            kernel_sink = kernel_sink + sudokus[index].SearchUsingTripleGuess(*place.first, place.second).was_found;
+        }
+    }, out);
+    out << ",\n"s;
+
+    std::vector<SudokuCandidates> candidate_states;
+    for (const Sudoku& sudoku : sudokus)
+    {
+        candidate_states.emplace_back(sudoku);
+    }
+    std::vector<SudokuCandidates> candidates = candidate_states;
+    const std::pair<const char*, bool (SudokuCandidates::*)()> reductions[] = {
+        { "SudokuCandidates::ReducePointing", &SudokuCandidates::ReducePointing },
+        { "SudokuCandidates::ReduceBoxLine", &SudokuCandidates::ReduceBoxLine },
+        { "SudokuCandidates::ReduceNakedSubsets", &SudokuCandidates::ReduceNakedSubsets },
+        { "SudokuCandidates::ReduceHiddenSubsets", &SudokuCandidates::ReduceHiddenSubsets },
+        { "SudokuCandidates::ReduceFish", &SudokuCandidates::ReduceFish },
+        { "SudokuCandidates::ReduceColoring", &SudokuCandidates::ReduceColoring },
+    };
+    for (const auto& [name, reduce] : reductions)
+    {
+        Measure(name, states, [&]() { candidates = candidate_states; }, [&, reduce = reduce]() {
+            for (SudokuCandidates& state : candidates)
+            {
+                kernel_sink = kernel_sink + (state.*reduce)();
+            }
+        }, out);
+        out << ",\n"s;
+    }
+
+    std::vector<SudokuPopularity> popularity_states;
+    for (const Sudoku& sudoku : sudokus)
+    {
+        popularity_states.emplace_back(sudoku);
+    }
+    std::vector<SudokuPopularity> popularities = popularity_states;
+    Measure("SudokuPopularity::SortPopularity"s, states, [&]() { popularities = popularity_states; }, [&]() {
+        for (SudokuPopularity& popularity : popularities)
+        {
+            popularity.SortPopularity();
+            kernel_sink = kernel_sink + popularity.begin()->first;
+        }
+    }, out);
+    out << ",\n"s;
+    Measure("SudokuPopularity::IncreasePolularity"s, states, [&]() { popularities = popularity_states; }, [&]() {
+        for (SudokuPopularity& popularity : popularities)
+        {
+            for (int number = 1; number <= 9; ++number)
+            {
+                popularity.IncreasePolularity(number);
+            }
+            kernel_sink = kernel_sink + popularity.IsEmpty();
+        }
+    }, out);
+    out << ",\n"s;
+
+    SudokuGrid grid(m_states.empty() ? SudokuInput(81, 0) : m_states.front());
+    Measure("SudokuGrid::FillGrid"s, states, no_setup, [&]() {
+        for (const SudokuInput& state : m_states)
+        {
+            grid.FillGrid(state);
+            kernel_sink = kernel_sink + grid.Values().size();
+        }
+    }, out);
+    out << ",\n"s;
+
+    std::vector<std::string> lines;
+    for (const SudokuInput& state : m_states)
+    {
+        std::string line;
+        for (int value : state)
+        {
+            line += static_cast<char>('0' + value);
+        }
+        lines.push_back(std::move(line));
+    }
+    Measure("SudokuGrid::TryFillGrid(line)"s, states, no_setup, [&]() {
+        for (const std::string& line : lines)
+        {
+            kernel_sink = kernel_sink + static_cast<bool>(grid.TryFillGrid(line));
+        }
+    }, out);
+    out << ",\n"s;
+
+    std::array<uint8_t, 81> canonical;
+    SudokuTransform transform;
+    Measure("SudokuCanonicalForm::Canonicalize"s, states, no_setup, [&]() {
+        for (const Sudoku& sudoku : sudokus)
+        {
+            kernel_sink = kernel_sink + SudokuCanonicalForm::Canonicalize(sudoku, canonical, transform);
+        }
+    }, out);
+    out << "\n  ]\n}"s << std::endl;
+}
+
+template <typename Setup, typename Kernel>
+void SudokuMicroBench::Measure(const std::string& name, size_t ops_per_round, Setup setup, Kernel kernel,
+    std::ostream& out) const
+{
+    using Clock = std::chrono::steady_clock;
+
+    SudokuPerfCounters counters;
+    size_t ops = 0;
+    Clock::duration elapsed = Clock::duration::zero();
+    // warm up the caches and the branch predictor
+    setup();
+    kernel();
+    while (ops_per_round > 0 && ops < m_min_ops)
+    {
+        setup();
+        const Clock::time_point start = Clock::now();
+        counters.Start();
+        kernel();
+        counters.Stop();
+        elapsed += Clock::now() - start;
+        ops += ops_per_round;
+    }
+
+    const double count = static_cast<double>(std::max<size_t>(ops, 1));
+    out << "    { \"name\": \""s << name << "\", \"ops\": "s << ops << ", \"ns_per_op\": "s
+        << static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / count
+        << ", \"cycles_per_op\": "s;
+    if (counters.HasCycles())
+    {
+        out << static_cast<double>(counters.Cycles()) / count;
+    }
+    else
+    {
+        out << "null"s;
+    }
+    out << ", \"instructions_per_op\": "s;
+    if (counters.HasInstructions())
+    {
+        out << static_cast<double>(counters.Instructions()) / count;
+    }
+    else
+    {
+        out << "null"s;
+    }
+    out << " }"s;
+}
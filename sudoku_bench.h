@@ -0,0 +1,77 @@
+#ifndef SUDOKU_BENCH_H
+#define SUDOKU_BENCH_H
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Corpus-level throughput benchmark of SudokuSolver::Solve.
+// Every dataset is solved `repeat` times on the calling thread, the report is
+// written as JSON so that runs of different builds can be compared.
+class SudokuBench
+{
+public:
+    using SudokuInput = std::vector<int>;
+
+    explicit SudokuBench(size_t repeat = 100);
+
+    void AddDataset(const std::string& name, std::vector<SudokuInput> puzzles);
+    // easy, medium, hard and extream datasets from sudoku_test.cpp
+    void AddEmbeddedDatasets();
+    // one puzzle of 81 characters per line
+    void AddFile(const std::string& path);
+
+    void Run(std::ostream& out) const;
+
+    // heap allocations made by the calling thread so far, always 0 unless
+    // built with SUDOKU_COUNT_ALLOCATIONS
+    static size_t Allocations();
+    static bool CountsAllocations();
+
+private:
+    struct SudokuBenchDataset
+    {
+        std::string name;
+        std::vector<SudokuInput> puzzles;
+    };
+
+    void RunDataset(const SudokuBenchDataset& dataset, std::ostream& out) const;
+
+private:
+    size_t m_repeat;
+    std::vector<SudokuBenchDataset> m_datasets;
+};
+
+// ----------------------------------------------------------------------------
+
+// Micro-benchmarks of the solver kernels on grid states captured while
+// solving real puzzles. Reports ns, cycles and instructions per call; the
+// hardware counters come from perf events on Linux, otherwise cycles fall back
+// to the time stamp counter and instructions are reported as null.
+class SudokuMicroBench
+{
+public:
+    using SudokuInput = std::vector<int>;
+
+    explicit SudokuMicroBench(size_t min_ops = 200000);
+
+    // Replays the solution steps of every puzzle and keeps the grid at the
+    // start, a quarter, a half and three quarters of the solve
+    void CaptureStates(const std::vector<SudokuInput>& puzzles);
+
+    void Run(std::ostream& out) const;
+
+private:
+    // setup runs before every round outside of the measurement,
+    // kernel runs one round of ops_per_round calls
+    template <typename Setup, typename Kernel>
+    void Measure(const std::string& name, size_t ops_per_round, Setup setup, Kernel kernel,
+        std::ostream& out) const;
+
+private:
+    size_t m_min_ops;
+    std::vector<SudokuInput> m_states;
+};
+
+#endif // SUDOKU_BENCH_H
@@ -0,0 +1,289 @@
+#include "sudoku_binary.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SUDOKU_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std::string_literals;
+
+namespace
+{
+constexpr char MAGIC[4] = { 'S', 'D', 'K', 'B' };
+constexpr size_t BUFFER_SIZE = 1 << 20;
+
+uint64_t ReadLittleEndian(const uint8_t* data, size_t size)
+{
+    uint64_t value = 0;
+    for (size_t i = size; i > 0; --i)
+    {
+        value = (value << 8) | data[i - 1];
+    }
+    return value;
+}
+
+void WriteLittleEndian(uint64_t value, uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        data[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+}
+
+void PackGrid(const SudokuGrid& grid, uint8_t* packed)
+{
+    const std::array<uint8_t, 81>& cells = grid.Values();
+    for (size_t i = 0; i < 40; ++i)
+    {
+        packed[i] = static_cast<uint8_t>(cells[2 * i] | (cells[2 * i + 1] << 4));
+    }
+    packed[40] = cells[80];
+}
+
+void UnpackCells(const uint8_t* packed, uint8_t* cells)
+{
+    for (size_t i = 0; i < 40; ++i)
+    {
+        cells[2 * i] = packed[i] & 0x0F;
+        cells[2 * i + 1] = packed[i] >> 4;
+    }
+    cells[80] = packed[40] & 0x0F;
+}
+
+// ----------------------------------------------------------------------------
+
+SudokuBinaryFile::SudokuBinaryFile(const std::string& path)
+{
+#ifdef SUDOKU_HAS_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd >= 0 && fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        void* map = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            m_map = static_cast<const uint8_t*>(map);
+            m_map_size = static_cast<size_t>(info.st_size);
+        }
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+#endif
+    const uint8_t* data = m_map;
+    size_t size = m_map_size;
+    if (data == nullptr)
+    {
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (file == nullptr)
+        {
+            throw std::invalid_argument("Can't open file "s + path);
+        }
+        uint8_t block[4096];
+        for (size_t read = 0; (read = std::fread(block, 1, sizeof(block), file)) > 0;)
+        {
+            m_buffer.insert(m_buffer.end(), block, block + read);
+        }
+        std::fclose(file);
+        data = m_buffer.data();
+        size = m_buffer.size();
+    }
+
+    if (size < HEADER_SIZE || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0 ||
+        ReadLittleEndian(data + 4, 2) != VERSION)
+    {
+        Unmap();
+        throw std::invalid_argument("Not a packed sudoku file "s + path);
+    }
+    m_flags = static_cast<uint16_t>(ReadLittleEndian(data + 6, 2));
+    m_record_size = HasSolutions() ? 2 * SUDOKU_PACKED_SIZE : SUDOKU_PACKED_SIZE;
+    const uint64_t count = ReadLittleEndian(data + 8, 8);
+    if (count > (size - HEADER_SIZE) / m_record_size)
+    {
+        Unmap();
+        throw std::invalid_argument("Packed sudoku file is truncated "s + path);
+    }
+    m_count = static_cast<size_t>(count);
+    m_records = data + HEADER_SIZE;
+}
+
+SudokuBinaryFile::~SudokuBinaryFile()
+{
+    Unmap();
+}
+
+void SudokuBinaryFile::Unmap()
+{
+#ifdef SUDOKU_HAS_MMAP
+    if (m_map != nullptr)
+    {
+        munmap(const_cast<uint8_t*>(m_map), m_map_size);
+        m_map = nullptr;
+    }
+#endif
+}
+
+bool SudokuBinaryFile::IsBinary(const std::string& path)
+{
+    if (path == "-"s)
+    {
+        return false;
+    }
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    char magic[sizeof(MAGIC)] = {};
+    const bool res = std::fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+        std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+    std::fclose(file);
+    return res;
+}
+
+// ----------------------------------------------------------------------------
+
+SudokuBinaryWriter::SudokuBinaryWriter(const std::string& path, bool with_solutions)
+    : m_with_solutions(with_solutions)
+{
+    m_file = std::fopen(path.c_str(), "wb");
+    if (m_file == nullptr)
+    {
+        throw std::invalid_argument("Can't open file "s + path);
+    }
+    std::setvbuf(m_file, nullptr, _IOFBF, BUFFER_SIZE);
+    // the count is rewritten by Close
+    uint8_t header[SudokuBinaryFile::HEADER_SIZE];
+    FillHeader(header);
+    Write(header, sizeof(header));
+}
+
+SudokuBinaryWriter::~SudokuBinaryWriter()
+{
+    try
+    {
+        Close();
+    }
+    catch (...)
+    {
+    }
+}
+
+void SudokuBinaryWriter::Add(const SudokuGrid& puzzle)
+{
+    if (m_with_solutions)
+    {
+        throw std::invalid_argument("Packed sudoku file expects a solution for every puzzle"s);
+    }
+    uint8_t packed[SUDOKU_PACKED_SIZE];
+    PackGrid(puzzle, packed);
+    Write(packed, sizeof(packed));
+    ++m_count;
+}
+
+void SudokuBinaryWriter::Add(const SudokuGrid& puzzle, const SudokuGrid& solution)
+{
+    if (!m_with_solutions)
+    {
+        throw std::invalid_argument("Packed sudoku file was opened without solutions"s);
+    }
+    uint8_t packed[2 * SUDOKU_PACKED_SIZE];
+    PackGrid(puzzle, packed);
+    PackGrid(solution, packed + SUDOKU_PACKED_SIZE);
+    Write(packed, sizeof(packed));
+    ++m_count;
+}
+
+void SudokuBinaryWriter::Close()
+{
+    if (m_file == nullptr)
+    {
+        return;
+    }
+    std::FILE* file = m_file;
+    m_file = nullptr;
+    uint8_t header[SudokuBinaryFile::HEADER_SIZE];
+    FillHeader(header);
+    const bool written =
+        std::fseek(file, 0, SEEK_SET) == 0 && std::fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    if (std::fclose(file) != 0 || !written)
+    {
+        throw std::runtime_error("Can't write packed sudoku file"s);
+    }
+}
+
+void SudokuBinaryWriter::FillHeader(uint8_t* header) const
+{
+    std::memcpy(header, MAGIC, sizeof(MAGIC));
+    WriteLittleEndian(SudokuBinaryFile::VERSION, header + 4, 2);
+    WriteLittleEndian(m_with_solutions ? SudokuBinaryFile::SOLVED_FLAG : 0, header + 6, 2);
+    WriteLittleEndian(m_count, header + 8, 8);
+}
+
+void SudokuBinaryWriter::Write(const uint8_t* data, size_t size)
+{
+    if (std::fwrite(data, 1, size, m_file) != size)
+    {
+        throw std::runtime_error("Can't write packed sudoku file"s);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+size_t ConvertTextToBinary(SudokuLineReader& reader, SudokuBinaryWriter& writer, std::ostream& err)
+{
+    size_t skipped = 0;
+    size_t number = 0;
+    SudokuGrid grid;
+    std::string_view line;
+    while (reader.NextLine(line))
+    {
+        ++number;
+        if (line.empty())
+        {
+            continue;
+        }
+        const SudokuValid parsed = grid.TryFillGrid(line);
+        if (!parsed)
+        {
+            ++skipped;
+            err << "Line "s << number << ": "s << parsed << std::endl;
+            continue;
+        }
+        writer.Add(grid);
+        if (number % 4096 == 0)
+        {
+            reader.Release();
+        }
+    }
+    return skipped;
+}
+
+void ConvertBinaryToText(const SudokuBinaryFile& file, std::ostream& out, bool solutions)
+{
+    std::string text;
+    std::array<uint8_t, 81> cells;
+    for (size_t index = 0; index < file.Size(); ++index)
+    {
+        UnpackCells(solutions ? file.PackedSolution(index) : file.PackedPuzzle(index), cells.data());
+        for (uint8_t value : cells)
+        {
+            text += value == 0 ? '.' : static_cast<char>('0' + value);
+        }
+        text += '\n';
+        if (text.size() >= BUFFER_SIZE)
+        {
+            out.write(text.data(), static_cast<std::streamsize>(text.size()));
+            text.clear();
+        }
+    }
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+}
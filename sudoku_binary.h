@@ -0,0 +1,143 @@
+#ifndef SUDOKU_BINARY_H
+#define SUDOKU_BINARY_H
+
+#include "sudoku.h"
+#include "sudoku_stream.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Packed grid file, 41 bytes per grid instead of 82 for a text line.
+//
+// header, 16 bytes, little-endian:
+//   "SDKB" | version (uint16) | flags (uint16) | count (uint64)
+// count records follow, each one is the puzzle and, with SOLVED_FLAG set, its
+// solved grid. A grid takes 41 bytes with two cells per byte, the even cell
+// in the low nibble, the last high nibble is 0.
+constexpr size_t SUDOKU_PACKED_SIZE = 41;
+
+// SUDOKU_PACKED_SIZE bytes to and from 81 cells; nibbles above 9 are kept by
+// UnpackCells and rejected by TryFillGrid
+void PackGrid(const SudokuGrid& grid, uint8_t* packed);
+void UnpackCells(const uint8_t* packed, uint8_t* cells);
+
+// Works for Sudoku as well, its masks are rebuilt by its TryFillGrid
+template <typename Grid>
+SudokuValid UnpackGrid(const uint8_t* packed, Grid& grid)
+{
+    std::array<uint8_t, 81> cells;
+    UnpackCells(packed, cells.data());
+    return grid.TryFillGrid(cells.data(), cells.size());
+}
+
+// ----------------------------------------------------------------------------
+
+// Read-only view of a packed file. Regular files are memory-mapped and the
+// records are handed out in place, other files are read whole.
+class SudokuBinaryFile
+{
+public:
+    static constexpr uint16_t VERSION = 1;
+    static constexpr uint16_t SOLVED_FLAG = 1;
+    static constexpr size_t HEADER_SIZE = 16;
+
+    explicit SudokuBinaryFile(const std::string& path);
+    ~SudokuBinaryFile();
+
+    SudokuBinaryFile(const SudokuBinaryFile&) = delete;
+    SudokuBinaryFile& operator=(const SudokuBinaryFile&) = delete;
+
+    // true when the file starts with the packed header magic
+    static bool IsBinary(const std::string& path);
+
+    size_t Size() const
+    {
+        return m_count;
+    }
+
+    bool HasSolutions() const
+    {
+        return (m_flags & SOLVED_FLAG) != 0;
+    }
+
+    // SUDOKU_PACKED_SIZE bytes inside the mapping
+    const uint8_t* PackedPuzzle(size_t index) const
+    {
+        assert(index < m_count);
+        return m_records + index * m_record_size;
+    }
+
+    const uint8_t* PackedSolution(size_t index) const
+    {
+        assert(index < m_count && HasSolutions());
+        return m_records + index * m_record_size + SUDOKU_PACKED_SIZE;
+    }
+
+    template <typename Grid>
+    SudokuValid LoadPuzzle(size_t index, Grid& grid) const
+    {
+        return UnpackGrid(PackedPuzzle(index), grid);
+    }
+
+    template <typename Grid>
+    SudokuValid LoadSolution(size_t index, Grid& grid) const
+    {
+        return UnpackGrid(PackedSolution(index), grid);
+    }
+
+private:
+    void Unmap();
+
+private:
+    const uint8_t* m_map = nullptr;
+    size_t m_map_size = 0;
+    std::vector<uint8_t> m_buffer;
+
+    const uint8_t* m_records = nullptr;
+    size_t m_record_size = SUDOKU_PACKED_SIZE;
+    size_t m_count = 0;
+    uint16_t m_flags = 0;
+};
+
+// ----------------------------------------------------------------------------
+
+// Writes a packed file, the count in the header is filled in by Close
+class SudokuBinaryWriter
+{
+public:
+    SudokuBinaryWriter(const std::string& path, bool with_solutions);
+    ~SudokuBinaryWriter();
+
+    SudokuBinaryWriter(const SudokuBinaryWriter&) = delete;
+    SudokuBinaryWriter& operator=(const SudokuBinaryWriter&) = delete;
+
+    void Add(const SudokuGrid& puzzle);
+    void Add(const SudokuGrid& puzzle, const SudokuGrid& solution);
+
+    void Close();
+
+private:
+    void FillHeader(uint8_t* header) const;
+    void Write(const uint8_t* data, size_t size);
+
+private:
+    std::FILE* m_file = nullptr;
+    bool m_with_solutions;
+    size_t m_count = 0;
+};
+
+// ----------------------------------------------------------------------------
+
+// Text lines to packed puzzles, bad lines are reported to err and skipped.
+// Returns the number of skipped lines.
+size_t ConvertTextToBinary(SudokuLineReader& reader, SudokuBinaryWriter& writer, std::ostream& err = std::cerr);
+
+// Packed puzzles (or solutions) to text lines, '.' marks an empty cell
+void ConvertBinaryToText(const SudokuBinaryFile& file, std::ostream& out, bool solutions = false);
+
+#endif // SUDOKU_BINARY_H
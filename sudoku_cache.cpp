@@ -0,0 +1,419 @@
+#include "sudoku_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+// blanks are compared as a value above every digit
+constexpr uint8_t BLANK = 10;
+
+constexpr uint8_t PERMUTATIONS[6][3] = { { 0, 1, 2 }, { 0, 2, 1 }, { 1, 0, 2 }, { 1, 2, 0 }, { 2, 0, 1 }, { 2, 1, 0 } };
+
+// splitmix64 finalizer over the pair
+uint64_t Mix(uint64_t seed, uint64_t value)
+{
+    uint64_t x = seed * 0x9E3779B97F4A7C15ull + value;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Signatures of the lines that every symmetry of the grid carries along: a
+// cell is signed by its digit and its two lines, a line by the cells of each
+// of its three boxes, a digit by its cells, refined over two rounds. Sums
+// of mixed values keep them free of the order.
+struct SudokuSignatures
+{
+    std::array<uint64_t, 9> rows = {};
+    std::array<uint64_t, 9> cols = {};
+    std::array<uint64_t, 3> bands = {};
+    std::array<uint64_t, 3> stacks = {};
+};
+
+void Sign(const uint8_t* cells, SudokuSignatures& signatures)
+{
+    std::array<uint64_t, 10> digits = {};
+    for (int index = 0; index < 81; ++index)
+    {
+        ++digits[cells[index]];
+    }
+    std::array<uint64_t, 81> signed_cells;
+    for (int round = 0; round < 2; ++round)
+    {
+        for (int index = 0; index < 81; ++index)
+        {
+            // the row and the col taken as a pair, so the transposed grid gets the swapped signatures
+            const uint64_t row = signatures.rows[index / 9];
+            const uint64_t col = signatures.cols[index % 9];
+            signed_cells[index] = Mix(Mix(digits[cells[index]], std::min(row, col)), std::max(row, col));
+        }
+        for (int line = 0; line < 9; ++line)
+        {
+            uint64_t row = 0;
+            uint64_t col = 0;
+            for (int box = 0; box < 3; ++box)
+            {
+                uint64_t row_box = 0;
+                uint64_t col_box = 0;
+                for (int i = box * 3; i < box * 3 + 3; ++i)
+                {
+                    row_box += Mix(1, signed_cells[line * 9 + i]);
+                    col_box += Mix(1, signed_cells[i * 9 + line]);
+                }
+                row += Mix(2, row_box);
+                col += Mix(2, col_box);
+            }
+            signatures.rows[line] = row;
+            signatures.cols[line] = col;
+        }
+        std::array<uint64_t, 10> refined = {};
+        for (int index = 0; index < 81; ++index)
+        {
+            refined[cells[index]] += Mix(3, signed_cells[index]);
+        }
+        for (int digit = 0; digit <= 9; ++digit)
+        {
+            digits[digit] = Mix(digits[digit], refined[digit]);
+        }
+    }
+    for (int group = 0; group < 3; ++group)
+    {
+        signatures.bands[group] = 0;
+        signatures.stacks[group] = 0;
+        for (int line = group * 3; line < group * 3 + 3; ++line)
+        {
+            signatures.bands[group] += Mix(4, signatures.rows[line]);
+            signatures.stacks[group] += Mix(4, signatures.cols[line]);
+        }
+    }
+}
+
+// The line orders that sort the groups of three by signature and the lines
+// of every group by signature; lines that tie give one order each way
+void SortedOrders(const std::array<uint64_t, 3>& groups, const std::array<uint64_t, 9>& lines,
+    std::vector<std::array<uint8_t, 9>>& orders)
+{
+    orders.clear();
+    const auto sorted = [](uint64_t first, uint64_t second, uint64_t third) {
+        return first <= second && second <= third;
+    };
+    for (const auto& outer : PERMUTATIONS)
+    {
+        if (!sorted(groups[outer[0]], groups[outer[1]], groups[outer[2]]))
+        {
+            continue;
+        }
+        uint8_t inner[3][6];
+        size_t inner_counts[3] = {};
+        for (int k = 0; k < 3; ++k)
+        {
+            const int first = outer[k] * 3;
+            for (int p = 0; p < 6; ++p)
+            {
+                const uint8_t* permutation = PERMUTATIONS[p];
+                if (sorted(lines[first + permutation[0]], lines[first + permutation[1]], lines[first + permutation[2]]))
+                {
+                    inner[k][inner_counts[k]++] = static_cast<uint8_t>(p);
+                }
+            }
+        }
+        std::array<uint8_t, 9> order;
+        for (size_t o0 = 0; o0 < inner_counts[0]; ++o0)
+        {
+            for (size_t o1 = 0; o1 < inner_counts[1]; ++o1)
+            {
+                for (size_t o2 = 0; o2 < inner_counts[2]; ++o2)
+                {
+                    const size_t picked[3] = { o0, o1, o2 };
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        const uint8_t* permutation = PERMUTATIONS[inner[k][picked[k]]];
+                        for (int i = 0; i < 3; ++i)
+                        {
+                            order[k * 3 + i] = static_cast<uint8_t>(outer[k] * 3 + permutation[i]);
+                        }
+                    }
+                    orders.push_back(order);
+                }
+            }
+        }
+    }
+}
+
+// Row in the col order of the candidate, digits seen for the first time get
+// the next labels. labels[0] is BLANK during the search, so the loop has no
+// branch to mispredict.
+void RelabelRow(const uint8_t* line, const std::array<uint8_t, 9>& cols, std::array<uint8_t, 10>& labels,
+    uint8_t& next_label, uint8_t* out)
+{
+    for (int j = 0; j < 9; ++j)
+    {
+        const uint8_t value = line[cols[j]];
+        const uint8_t label = labels[value];
+        const uint8_t fresh = label == 0;
+        labels[value] = static_cast<uint8_t>(label | (fresh * next_label));
+        next_label = static_cast<uint8_t>(next_label + fresh);
+        out[j] = labels[value];
+    }
+}
+}
+
+void SudokuTransform::Apply(const uint8_t* cells, uint8_t* transformed) const
+{
+    for (int i = 0; i < 9; ++i)
+    {
+        for (int j = 0; j < 9; ++j)
+        {
+            const int source = transpose ? cols[j] * 9 + rows[i] : rows[i] * 9 + cols[j];
+            transformed[i * 9 + j] = labels[cells[source]];
+        }
+    }
+}
+
+void SudokuTransform::Revert(const uint8_t* transformed, uint8_t* cells) const
+{
+    std::array<uint8_t, 10> digits = {};
+    for (uint8_t digit = 1; digit <= 9; ++digit)
+    {
+        digits[labels[digit]] = digit;
+    }
+    for (int i = 0; i < 9; ++i)
+    {
+        for (int j = 0; j < 9; ++j)
+        {
+            const int source = transpose ? cols[j] * 9 + rows[i] : rows[i] * 9 + cols[j];
+            cells[source] = digits[transformed[i * 9 + j]];
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+bool SudokuCanonicalForm::Canonicalize(const SudokuGrid& grid, std::array<uint8_t, 81>& canonical,
+    SudokuTransform& transform)
+{
+    thread_local std::array<std::vector<std::array<uint8_t, 9>>, 2> row_buffers;
+    thread_local std::array<std::vector<std::array<uint8_t, 9>>, 2> col_buffers;
+
+    // cells[1] is the transposed grid
+    uint8_t cells[2][81];
+    for (int index = 0; index < 81; ++index)
+    {
+        cells[0][index] = grid.Values()[index];
+        cells[1][(index % 9) * 9 + index / 9] = grid.Values()[index];
+    }
+
+    // The orientation with the smaller sorted band and stack signatures,
+    // both when they tie; the transposed grid swaps rows and cols
+    SudokuSignatures signatures[2];
+    Sign(cells[0], signatures[0]);
+    signatures[1].rows = signatures[0].cols;
+    signatures[1].cols = signatures[0].rows;
+    signatures[1].bands = signatures[0].stacks;
+    signatures[1].stacks = signatures[0].bands;
+    std::array<uint64_t, 6> layouts[2];
+    for (int transpose = 0; transpose < 2; ++transpose)
+    {
+        std::array<uint64_t, 3> bands = signatures[transpose].bands;
+        std::array<uint64_t, 3> stacks = signatures[transpose].stacks;
+        std::sort(bands.begin(), bands.end());
+        std::sort(stacks.begin(), stacks.end());
+        std::copy(bands.begin(), bands.end(), layouts[transpose].begin());
+        std::copy(stacks.begin(), stacks.end(), layouts[transpose].begin() + 3);
+    }
+
+    size_t candidates = 0;
+    for (int transpose = 0; transpose < 2; ++transpose)
+    {
+        row_buffers[transpose].clear();
+        col_buffers[transpose].clear();
+        if (layouts[transpose] > layouts[1 - transpose])
+        {
+            continue;
+        }
+        SortedOrders(signatures[transpose].bands, signatures[transpose].rows, row_buffers[transpose]);
+        SortedOrders(signatures[transpose].stacks, signatures[transpose].cols, col_buffers[transpose]);
+        candidates += row_buffers[transpose].size() * col_buffers[transpose].size();
+    }
+    // too many ties to be worth following
+    if (candidates > CANDIDATE_LIMIT)
+    {
+        return false;
+    }
+
+    // the smallest grid of the sorted orders, row by row; a candidate stops
+    // at its first row above the best
+    uint8_t best[81];
+    bool found = false;
+    for (int transpose = 0; transpose < 2; ++transpose)
+    {
+        for (const std::array<uint8_t, 9>& rows : row_buffers[transpose])
+        {
+            for (const std::array<uint8_t, 9>& cols : col_buffers[transpose])
+            {
+                std::array<uint8_t, 10> labels = {};
+                labels[0] = BLANK;
+                uint8_t next_label = 1;
+                uint8_t row_values[9];
+                int order = found ? 0 : -1;
+                for (int depth = 0; depth < 9 && order <= 0; ++depth)
+                {
+                    RelabelRow(cells[transpose] + rows[depth] * 9, cols, labels, next_label, row_values);
+                    if (order == 0)
+                    {
+                        order = std::memcmp(row_values, best + depth * 9, 9);
+                    }
+                    if (order < 0)
+                    {
+                        std::memcpy(best + depth * 9, row_values, 9);
+                    }
+                }
+                if (order < 0)
+                {
+                    found = true;
+                    transform.transpose = transpose != 0;
+                    transform.rows = rows;
+                    transform.cols = cols;
+                    transform.labels = labels;
+                    transform.labels[0] = 0;
+                    for (int digit = 1; digit <= 9; ++digit)
+                    {
+                        if (transform.labels[digit] == 0)
+                        {
+                            transform.labels[digit] = next_label++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    transform.Apply(grid.Values().data(), canonical.data());
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+SudokuSolutionCache::SudokuSolutionCache(size_t capacity, size_t shard_count)
+    : m_shard_count(std::max<size_t>(shard_count, 1)),
+      m_shard_capacity(std::max<size_t>(capacity / m_shard_count, 1)),
+      m_shards(new SudokuCacheShard[m_shard_count])
+{
+}
+
+void SudokuSolutionCache::Solve(Sudoku& sudoku, SudokuResult& result, SudokuStrategy* strategy,
+    SudokuMetrics* metrics, SudokuTracer* tracer)
+{
+    SudokuKey key;
+    SudokuKey solution;
+    SudokuTransform transform;
+    const bool canonical = SudokuCanonicalForm::Canonicalize(sudoku, key, transform);
+    if (canonical && FindEntry(key, solution))
+    {
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        SudokuKey cells;
+        transform.Revert(solution.data(), cells.data());
+        sudoku.TryFillGrid(cells.data(), cells.size());
+        result.Clear();
+        return;
+    }
+
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    SudokuSolver solver(sudoku);
+    solver.SetStrategy(strategy);
+    solver.SetMetrics(metrics);
+    solver.SetTracer(tracer);
+    solver.Solve(result);
+    if (result && canonical)
+    {
+        transform.Apply(sudoku.Values().data(), solution.data());
+        InsertEntry(key, solution);
+    }
+}
+
+bool SudokuSolutionCache::Find(const SudokuGrid& puzzle, SudokuGrid& solution)
+{
+    SudokuKey key;
+    SudokuTransform transform;
+    SudokuKey canonical_solution;
+    if (!SudokuCanonicalForm::Canonicalize(puzzle, key, transform) || !FindEntry(key, canonical_solution))
+    {
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    SudokuKey cells;
+    transform.Revert(canonical_solution.data(), cells.data());
+    solution.TryFillGrid(cells.data(), cells.size());
+    return true;
+}
+
+void SudokuSolutionCache::Insert(const SudokuGrid& puzzle, const SudokuGrid& solution)
+{
+    SudokuKey key;
+    SudokuTransform transform;
+    if (!SudokuCanonicalForm::Canonicalize(puzzle, key, transform))
+    {
+        return;
+    }
+    SudokuKey canonical_solution;
+    transform.Apply(solution.Values().data(), canonical_solution.data());
+    InsertEntry(key, canonical_solution);
+}
+
+size_t SudokuSolutionCache::SudokuKeyHash::operator()(const SudokuKey& key) const
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (uint8_t value : key)
+    {
+        hash = (hash ^ value) * 1099511628211ull;
+    }
+    return static_cast<size_t>(hash);
+}
+
+SudokuSolutionCache::SudokuCacheShard& SudokuSolutionCache::Shard(const SudokuKey& key)
+{
+    // the low bits pick the bucket inside the shard
+    const size_t hash = SudokuKeyHash()(key);
+    return m_shards[(hash ^ (hash >> 16)) / 7 % m_shard_count];
+}
+
+bool SudokuSolutionCache::FindEntry(const SudokuKey& key, SudokuKey& solution)
+{
+    SudokuCacheShard& shard = Shard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.index.find(key);
+    if (found == shard.index.end())
+    {
+        return false;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+    solution = found->second->second;
+    return true;
+}
+
+void SudokuSolutionCache::InsertEntry(const SudokuKey& key, const SudokuKey& solution)
+{
+    SudokuCacheShard& shard = Shard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.index.find(key);
+    if (found != shard.index.end())
+    {
+        shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+        return;
+    }
+    if (shard.entries.size() >= m_shard_capacity)
+    {
+        // the least recently used node is reused for the new entry
+        shard.index.erase(shard.entries.back().first);
+        shard.entries.splice(shard.entries.begin(), shard.entries, std::prev(shard.entries.end()));
+        shard.entries.front() = { key, solution };
+    }
+    else
+    {
+        shard.entries.emplace_front(key, solution);
+    }
+    shard.index.emplace(key, shard.entries.begin());
+}
@@ -0,0 +1,111 @@
+#ifndef SUDOKU_CACHE_H
+#define SUDOKU_CACHE_H
+
+#include "sudoku.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// One element of the sudoku symmetry group: transposition, a row order and a
+// col order that keep bands and stacks together, and a relabelling of digits
+struct SudokuTransform
+{
+    bool transpose = false;
+    // canonical row i is row rows[i] of the (transposed) grid, same for cols
+    std::array<uint8_t, 9> rows = {};
+    std::array<uint8_t, 9> cols = {};
+    // canonical label of every digit, labels[0] stays 0
+    std::array<uint8_t, 10> labels = {};
+
+    // 81 cells of the grid to 81 cells of the transformed grid
+    void Apply(const uint8_t* cells, uint8_t* transformed) const;
+    // and back
+    void Revert(const uint8_t* transformed, uint8_t* cells) const;
+};
+
+// Maps a grid to the lexicographically smallest grid, blanks counting as
+// greater than any digit, among the transforms that sort the bands, rows,
+// stacks and cols by signatures every symmetry carries along. Equivalent
+// grids sort the same way, so they meet in one form, and the signatures
+// leave a single order for most puzzles; grids symmetric enough to leave
+// more than a few thousand tied orders (an empty or a complete grid) are
+// not canonicalized.
+class SudokuCanonicalForm
+{
+public:
+    // false when the grid has too many symmetries, canonical is not filled then
+    static bool Canonicalize(const SudokuGrid& grid, std::array<uint8_t, 81>& canonical,
+        SudokuTransform& transform);
+
+    static constexpr size_t CANDIDATE_LIMIT = 4096;
+};
+
+// ----------------------------------------------------------------------------
+
+// Bounded LRU cache of solutions keyed by the canonical form of the puzzle,
+// one entry per puzzle, so relabelled, transposed or permuted repeats hit
+// the same entry. Puzzles too symmetric to canonicalize are solved without
+// the cache. The entries are split over shards with a lock each.
+class SudokuSolutionCache
+{
+public:
+    explicit SudokuSolutionCache(size_t capacity, size_t shard_count = 16);
+
+    // SudokuSolver::Solve through the cache, a miss is solved with the
+    // strategy, the metrics and the tracer. A hit fills the sudoku with the
+    // stored solution turned back to its orientation, the result has no
+    // solution steps then.
+    void Solve(Sudoku& sudoku, SudokuResult& result, SudokuStrategy* strategy = nullptr,
+        SudokuMetrics* metrics = nullptr, SudokuTracer* tracer = nullptr);
+
+    // solution is written as a plain grid, a Sudoku has to be refilled
+    // through its own TryFillGrid
+    bool Find(const SudokuGrid& puzzle, SudokuGrid& solution);
+    void Insert(const SudokuGrid& puzzle, const SudokuGrid& solution);
+
+    size_t Hits() const
+    {
+        return m_hits.load(std::memory_order_relaxed);
+    }
+
+    size_t Misses() const
+    {
+        return m_misses.load(std::memory_order_relaxed);
+    }
+
+private:
+    using SudokuKey = std::array<uint8_t, 81>;
+
+    struct SudokuKeyHash
+    {
+        size_t operator()(const SudokuKey& key) const;
+    };
+
+    struct SudokuCacheShard
+    {
+        std::mutex mutex;
+        // most recently used first
+        std::list<std::pair<SudokuKey, SudokuKey>> entries;
+        std::unordered_map<SudokuKey, std::list<std::pair<SudokuKey, SudokuKey>>::iterator, SudokuKeyHash> index;
+    };
+
+    SudokuCacheShard& Shard(const SudokuKey& key);
+    // key and solution in the same orientation
+    bool FindEntry(const SudokuKey& key, SudokuKey& solution);
+    void InsertEntry(const SudokuKey& key, const SudokuKey& solution);
+
+private:
+    size_t m_shard_count;
+    size_t m_shard_capacity;
+    std::unique_ptr<SudokuCacheShard[]> m_shards;
+    std::atomic<size_t> m_hits{ 0 };
+    std::atomic<size_t> m_misses{ 0 };
+};
+
+#endif // SUDOKU_CACHE_H
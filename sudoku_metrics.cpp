@@ -0,0 +1,340 @@
+#include "sudoku_metrics.h"
+
+#include "sudoku_cache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+namespace
+{
+int HighestBit(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while ((value >>= 1) != 0)
+    {
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+// bounds of the Prometheus buckets, powers of two from 1 us to 17 s fall on
+// bounds of the histogram
+constexpr int LE_FIRST_BIT = 10;
+constexpr int LE_LAST_BIT = 34;
+
+const char* SeriesName(size_t tier)
+{
+    return tier < SudokuMetrics::UNRATED ? TierName(static_cast<SudokuTier>(tier)) : "unrated";
+}
+}
+
+size_t SudokuHistogram::Bucket(uint64_t value)
+{
+    if (value < SUB_BUCKETS)
+    {
+        return static_cast<size_t>(value);
+    }
+    const int bit = HighestBit(value);
+    if (bit >= 40)
+    {
+        return BUCKETS - 1;
+    }
+    // 8 buckets per bit above the first 3, told apart by the 3 bits below the highest
+    return SUB_BUCKETS * static_cast<size_t>(bit - 2) + static_cast<size_t>((value >> (bit - 3)) & 0x7);
+}
+
+uint64_t SudokuHistogram::Lowest(size_t bucket)
+{
+    if (bucket < SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    const size_t bit = bucket / SUB_BUCKETS + 2;
+    return (SUB_BUCKETS + bucket % SUB_BUCKETS) << (bit - 3);
+}
+
+uint64_t SudokuHistogram::Percentile(double percentile) const
+{
+    if (m_count == 0)
+    {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percentile / 100.0 * m_count)));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKETS; ++bucket)
+    {
+        seen += m_counts[bucket];
+        if (seen >= rank)
+        {
+            return Lowest(bucket + 1) - 1;
+        }
+    }
+    return Lowest(BUCKETS) - 1;
+}
+
+uint64_t SudokuHistogram::CountBelow(uint64_t limit) const
+{
+    uint64_t count = 0;
+    for (size_t bucket = 0; bucket < BUCKETS && Lowest(bucket + 1) <= limit; ++bucket)
+    {
+        count += m_counts[bucket];
+    }
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+
+SudokuMetrics::SudokuMetrics()
+    : m_shards(std::make_unique<SudokuMetricsShard[]>(SHARDS)), m_start(std::chrono::steady_clock::now())
+{
+}
+
+void SudokuMetrics::RecordSolve(const SudokuResult& result, uint64_t nanoseconds)
+{
+    if (!result)
+    {
+        Shard().failures[static_cast<size_t>(result.valid.error)].fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    const size_t tier =
+        result.solution_steps.empty() ? UNRATED : static_cast<size_t>(SudokuRater::Rate(result).tier);
+    Record(tier, nanoseconds);
+}
+
+void SudokuMetrics::RecordValidation(uint64_t nanoseconds)
+{
+    Record(VALIDATION, nanoseconds);
+}
+
+void SudokuMetrics::Snapshot(SudokuMetricsSnapshot& snapshot) const
+{
+    snapshot = SudokuMetricsSnapshot();
+    snapshot.uptime_seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    for (size_t shard = 0; shard < SHARDS; ++shard)
+    {
+        const SudokuMetricsShard& counters = m_shards[shard];
+        for (size_t series = 0; series < SERIES; ++series)
+        {
+            SudokuHistogram& histogram = series == VALIDATION ? snapshot.validations : snapshot.solves[series];
+            for (size_t bucket = 0; bucket < SudokuHistogram::BUCKETS; ++bucket)
+            {
+                const uint64_t count = counters.counts[series][bucket].load(std::memory_order_relaxed);
+                if (count != 0)
+                {
+                    histogram.Add(bucket, count);
+                }
+            }
+            histogram.AddSum(counters.sums[series].load(std::memory_order_relaxed));
+        }
+        for (size_t error = 0; error < ERRORS; ++error)
+        {
+            snapshot.failures[error] += counters.failures[error].load(std::memory_order_relaxed);
+        }
+    }
+    if (m_cache != nullptr)
+    {
+        snapshot.has_cache = true;
+        snapshot.cache_hits = m_cache->Hits();
+        snapshot.cache_misses = m_cache->Misses();
+    }
+}
+
+void SudokuMetrics::Write(SudokuMetricsFormat format, std::ostream& out) const
+{
+    SudokuMetricsSnapshot snapshot;
+    Snapshot(snapshot);
+    if (format == SudokuMetricsFormat::Json)
+    {
+        WriteJson(snapshot, out);
+    }
+    else
+    {
+        WritePrometheus(snapshot, out);
+    }
+}
+
+SudokuMetrics::SudokuMetricsShard& SudokuMetrics::Shard()
+{
+    static std::atomic<size_t> next{ 0 };
+    thread_local const size_t shard = next.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+    return m_shards[shard];
+}
+
+void SudokuMetrics::Record(size_t series, uint64_t nanoseconds)
+{
+    SudokuMetricsShard& shard = Shard();
+    shard.counts[series][SudokuHistogram::Bucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    shard.sums[series].fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+void SudokuMetrics::WritePrometheus(const SudokuMetricsSnapshot& snapshot, std::ostream& out)
+{
+    const auto histogram = [&out](const std::string& name, const std::string& labels,
+                               const SudokuHistogram& values) {
+        const std::string separator = labels.empty() ? ""s : ","s;
+        for (int bit = LE_FIRST_BIT; bit <= LE_LAST_BIT; ++bit)
+        {
+            out << name << "_bucket{"s << labels << separator << "le=\""s << static_cast<double>(1ull << bit) * 1e-9
+                << "\"} "s << values.CountBelow(1ull << bit) << "\n"s;
+        }
+        out << name << "_bucket{"s << labels << separator << "le=\"+Inf\"} "s << values.Count() << "\n"s;
+        const std::string braces = labels.empty() ? ""s : "{"s + labels + "}"s;
+        out << name << "_sum"s << braces << " "s << static_cast<double>(values.Sum()) * 1e-9 << "\n"s;
+        out << name << "_count"s << braces << " "s << values.Count() << "\n"s;
+    };
+
+    out << "# HELP sudoku_uptime_seconds Time since the metrics were created\n"s
+        << "# TYPE sudoku_uptime_seconds gauge\n"s
+        << "sudoku_uptime_seconds "s << snapshot.uptime_seconds << "\n"s;
+
+    out << "# HELP sudoku_solve_seconds Latency of the solves by the tier of the result\n"s
+        << "# TYPE sudoku_solve_seconds histogram\n"s;
+    for (size_t tier = 0; tier < snapshot.solves.size(); ++tier)
+    {
+        histogram("sudoku_solve_seconds"s, "tier=\""s + SeriesName(tier) + "\""s, snapshot.solves[tier]);
+    }
+
+    out << "# HELP sudoku_validation_seconds Latency of the validity check before a solve\n"s
+        << "# TYPE sudoku_validation_seconds histogram\n"s;
+    histogram("sudoku_validation_seconds"s, ""s, snapshot.validations);
+
+    out << "# HELP sudoku_failures_total Solves that gave no solution by the error\n"s
+        << "# TYPE sudoku_failures_total counter\n"s;
+    for (size_t error = 1; error < snapshot.failures.size(); ++error)
+    {
+        out << "sudoku_failures_total{error=\""s << ErrorName(static_cast<SudokuError>(error)) << "\"} "s
+            << snapshot.failures[error] << "\n"s;
+    }
+
+    if (snapshot.has_cache)
+    {
+        out << "# HELP sudoku_cache_lookups_total Solution cache lookups by the outcome\n"s
+            << "# TYPE sudoku_cache_lookups_total counter\n"s
+            << "sudoku_cache_lookups_total{outcome=\"hit\"} "s << snapshot.cache_hits << "\n"s
+            << "sudoku_cache_lookups_total{outcome=\"miss\"} "s << snapshot.cache_misses << "\n"s;
+    }
+}
+
+void SudokuMetrics::WriteJson(const SudokuMetricsSnapshot& snapshot, std::ostream& out)
+{
+    const auto latency = [&out](const SudokuHistogram& values) {
+        out << "\"count\": "s << values.Count() << ", \"latency_ns\": { \"mean\": "s
+            << (values.Count() > 0 ? static_cast<double>(values.Sum()) / values.Count() : 0.0)
+            << ", \"p50\": "s << values.Percentile(50.0) << ", \"p99\": "s << values.Percentile(99.0)
+            << ", \"p99.9\": "s << values.Percentile(99.9) << ", \"max\": "s << values.Percentile(100.0) << " }"s;
+    };
+
+    out << "{\n  \"uptime_seconds\": "s << snapshot.uptime_seconds << ",\n  \"solves\": [\n"s;
+    for (size_t tier = 0; tier < snapshot.solves.size(); ++tier)
+    {
+        out << "    { \"tier\": \""s << SeriesName(tier) << "\", "s;
+        latency(snapshot.solves[tier]);
+        out << (tier + 1 < snapshot.solves.size() ? " },\n"s : " }\n"s);
+    }
+    out << "  ],\n  \"validation\": { "s;
+    latency(snapshot.validations);
+    out << " },\n  \"failures\": {"s;
+    for (size_t error = 1; error < snapshot.failures.size(); ++error)
+    {
+        out << (error == 1 ? " "s : ", "s) << "\""s << ErrorName(static_cast<SudokuError>(error)) << "\": "s
+            << snapshot.failures[error];
+    }
+    out << " },\n  \"cache\": "s;
+    if (snapshot.has_cache)
+    {
+        const uint64_t lookups = snapshot.cache_hits + snapshot.cache_misses;
+        out << "{ \"hits\": "s << snapshot.cache_hits << ", \"misses\": "s << snapshot.cache_misses
+            << ", \"hit_rate\": "s << (lookups > 0 ? static_cast<double>(snapshot.cache_hits) / lookups : 0.0)
+            << " }\n"s;
+    }
+    else
+    {
+        out << "null\n"s;
+    }
+    out << "}\n"s;
+}
+
+// ----------------------------------------------------------------------------
+
+SudokuMetricsExporter::SudokuMetricsExporter(const SudokuMetrics& metrics, const std::string& path,
+    SudokuMetricsFormat format, std::chrono::milliseconds period)
+    : m_metrics(metrics), m_path(path), m_format(format), m_period(period)
+{
+    m_thread = std::thread(&SudokuMetricsExporter::Loop, this);
+}
+
+SudokuMetricsExporter::~SudokuMetricsExporter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+void SudokuMetricsExporter::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+    Export();
+}
+
+void SudokuMetricsExporter::Export() const
+{
+    std::ostringstream text;
+    m_metrics.Write(m_format, text);
+    const std::string snapshot = text.str();
+
+    const std::string temporary = m_path + ".tmp"s;
+    std::FILE* file = std::fopen(temporary.c_str(), "w");
+    if (file == nullptr)
+    {
+        throw std::invalid_argument("Can't open file "s + temporary);
+    }
+    bool written = std::fwrite(snapshot.data(), 1, snapshot.size(), file) == snapshot.size();
+    written = std::fclose(file) == 0 && written;
+    if (!written || std::rename(temporary.c_str(), m_path.c_str()) != 0)
+    {
+        std::remove(temporary.c_str());
+        throw std::runtime_error("Can't write metrics file "s + m_path);
+    }
+}
+
+void SudokuMetricsExporter::Loop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_wake.wait_for(lock, m_period, [this]() { return m_stop; }))
+    {
+        lock.unlock();
+        try
+        {
+            Export();
+        }
+        catch (const std::exception&)
+        {
+            // the next period tries again
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,196 @@
+#ifndef SUDOKU_METRICS_H
+#define SUDOKU_METRICS_H
+
+#include "sudoku.h"
+#include "sudoku_rating.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class SudokuSolutionCache;
+
+// Log-linear histogram of nanoseconds in the manner of HDR histograms: the
+// values below 8 have a bucket each, every power of two above is split into
+// 8 buckets, so a bucket bound is within 12.5% of the values it holds.
+// Values from 2^40 ns (about 18 minutes) share the last bucket.
+class SudokuHistogram
+{
+public:
+    static constexpr size_t SUB_BUCKETS = 8;
+    static constexpr size_t BUCKETS = SUB_BUCKETS * 38;
+
+    static size_t Bucket(uint64_t value);
+    // smallest value of the bucket, Lowest(BUCKETS) is the end of the range
+    static uint64_t Lowest(size_t bucket);
+
+    void Add(uint64_t value)
+    {
+        ++m_counts[Bucket(value)];
+        ++m_count;
+        m_sum += value;
+    }
+
+    void Add(size_t bucket, uint64_t count)
+    {
+        m_counts[bucket] += count;
+        m_count += count;
+    }
+
+    void AddSum(uint64_t sum)
+    {
+        m_sum += sum;
+    }
+
+    uint64_t Count() const
+    {
+        return m_count;
+    }
+
+    uint64_t Sum() const
+    {
+        return m_sum;
+    }
+
+    uint64_t Counts(size_t bucket) const
+    {
+        return m_counts[bucket];
+    }
+
+    // highest value of the bucket holding the percentile, 0 when empty
+    uint64_t Percentile(double percentile) const;
+    // values below the limit when the limit is a bucket bound
+    uint64_t CountBelow(uint64_t limit) const;
+
+private:
+    std::array<uint64_t, BUCKETS> m_counts = {};
+    uint64_t m_count = 0;
+    uint64_t m_sum = 0;
+};
+
+// ----------------------------------------------------------------------------
+
+enum class SudokuMetricsFormat : uint8_t
+{
+    // text exposition format, e.g. for the node exporter textfile collector
+    Prometheus,
+    Json
+};
+
+// Process-wide solver metrics: solve latency per SudokuTier of the result,
+// validation latency, failures per SudokuError and the hits and misses of a
+// SudokuSolutionCache. Every thread counts into a shard of its own with
+// relaxed atomics, a snapshot sums the shards, so recording takes no lock
+// and shares no cache line between threads as long as there are no more
+// threads than shards.
+class SudokuMetrics
+{
+public:
+    // solves without solution steps, cache hits and grids that came full
+    static constexpr size_t UNRATED = static_cast<size_t>(SudokuTier::Extreme) + 1;
+    static constexpr size_t SHARDS = 16;
+    static constexpr size_t ERRORS = static_cast<size_t>(SudokuError::BadCharacter) + 1;
+
+    SudokuMetrics();
+
+    SudokuMetrics(const SudokuMetrics&) = delete;
+    SudokuMetrics& operator=(const SudokuMetrics&) = delete;
+
+    // One solve as the caller saw it, through the cache or not. The tier is
+    // read from the solution steps, a failed solve only counts as a failure.
+    void RecordSolve(const SudokuResult& result, uint64_t nanoseconds);
+    void RecordValidation(uint64_t nanoseconds);
+
+    // The hits and misses of the cache are reported while it is set
+    void SetCache(const SudokuSolutionCache* cache)
+    {
+        m_cache = cache;
+    }
+
+    struct SudokuMetricsSnapshot
+    {
+        double uptime_seconds = 0.0;
+        // [UNRATED] for the solves without steps
+        std::array<SudokuHistogram, UNRATED + 1> solves;
+        SudokuHistogram validations;
+        // by SudokuError
+        std::array<uint64_t, ERRORS> failures = {};
+        bool has_cache = false;
+        uint64_t cache_hits = 0;
+        uint64_t cache_misses = 0;
+    };
+
+    // Not atomic as a whole, a solve recorded meanwhile may be half counted
+    void Snapshot(SudokuMetricsSnapshot& snapshot) const;
+    void Write(SudokuMetricsFormat format, std::ostream& out) const;
+
+private:
+    static constexpr size_t SERIES = UNRATED + 2;
+    static constexpr size_t VALIDATION = UNRATED + 1;
+
+    struct alignas(64) SudokuMetricsShard
+    {
+        std::array<std::array<std::atomic<uint64_t>, SudokuHistogram::BUCKETS>, SERIES> counts;
+        std::array<std::atomic<uint64_t>, SERIES> sums;
+        std::array<std::atomic<uint64_t>, ERRORS> failures;
+    };
+
+    // shard of the calling thread
+    SudokuMetricsShard& Shard();
+    void Record(size_t series, uint64_t nanoseconds);
+
+    static void WritePrometheus(const SudokuMetricsSnapshot& snapshot, std::ostream& out);
+    static void WriteJson(const SudokuMetricsSnapshot& snapshot, std::ostream& out);
+
+private:
+    std::unique_ptr<SudokuMetricsShard[]> m_shards;
+    std::chrono::steady_clock::time_point m_start;
+    const SudokuSolutionCache* m_cache = nullptr;
+};
+
+// ----------------------------------------------------------------------------
+
+// Writes a snapshot of the metrics to a file every period from a thread of
+// its own. A snapshot goes to path + ".tmp" first and is renamed over the
+// file, so a reader never sees half of one. A snapshot that can't be written
+// is retried in the next period.
+class SudokuMetricsExporter
+{
+public:
+    SudokuMetricsExporter(const SudokuMetrics& metrics, const std::string& path, SudokuMetricsFormat format,
+        std::chrono::milliseconds period);
+    ~SudokuMetricsExporter();
+
+    SudokuMetricsExporter(const SudokuMetricsExporter&) = delete;
+    SudokuMetricsExporter& operator=(const SudokuMetricsExporter&) = delete;
+
+    // Stops the thread and writes the last snapshot
+    void Stop();
+    // Writes a snapshot now, throws std::invalid_argument when the file can't
+    // be opened and std::runtime_error when it can't be written
+    void Export() const;
+
+private:
+    void Loop();
+
+private:
+    const SudokuMetrics& m_metrics;
+    std::string m_path;
+    SudokuMetricsFormat m_format;
+    std::chrono::milliseconds m_period;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stop = false;
+    std::thread m_thread;
+};
+
+#endif // SUDOKU_METRICS_H
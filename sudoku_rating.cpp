@@ -0,0 +1,68 @@
+#include "sudoku_rating.h"
+
+const char* TierName(SudokuTier tier)
+{
+    switch (tier)
+    {
+    case SudokuTier::Easy:
+        return "easy";
+    case SudokuTier::Medium:
+        return "medium";
+    case SudokuTier::Hard:
+        return "hard";
+    case SudokuTier::Extreme:
+        return "extreme";
+    default:
+        return "unknown";
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+SudokuRating SudokuRater::Rate(const SudokuResult& result)
+{
+    SudokuRating rating;
+    if (result.solution_steps.empty())
+    {
+        return rating;
+    }
+
+    for (const SudokuStep& step : result.solution_steps)
+    {
+        ++rating.placements[step.technique];
+    }
+    // passes only grow along the steps
+    rating.passes = result.solution_steps.back().pass;
+
+    float score = PASS_WEIGHT * rating.passes;
+    for (size_t technique = 0; technique < rating.placements.size(); ++technique)
+    {
+        if (rating.placements[technique] == 0)
+        {
+            continue;
+        }
+        rating.hardest = static_cast<SudokuTechnique>(technique);
+        score += PLACEMENT_WEIGHT * (TECHNIQUE_WEIGHTS[technique] - 1.0f) * rating.placements[technique];
+    }
+    rating.score = score + TECHNIQUE_WEIGHTS[static_cast<size_t>(rating.hardest)];
+    rating.tier = Tier(rating.score);
+    return rating;
+}
+
+SudokuRating SudokuRater::Rate(Sudoku& sudoku, SudokuResult& result)
+{
+    SudokuSolver solver(sudoku);
+    solver.SetRating(true);
+    solver.Solve(result);
+    return Rate(result);
+}
+
+SudokuTier SudokuRater::Tier(float score)
+{
+    size_t tier = 0;
+    while (tier < TIER_LIMITS.size() && score >= TIER_LIMITS[tier])
+    {
+        ++tier;
+    }
+    return static_cast<SudokuTier>(tier);
+}
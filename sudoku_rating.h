@@ -0,0 +1,58 @@
+#ifndef SUDOKU_RATING_H
+#define SUDOKU_RATING_H
+
+#include "sudoku.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+enum class SudokuTier : uint8_t
+{
+    Easy,
+    Medium,
+    Hard,
+    Extreme
+};
+
+const char* TierName(SudokuTier tier);
+
+// Difficulty of one solve, read from its technique trace
+struct SudokuRating
+{
+    // 0 for a grid that needed nothing, at least TECHNIQUE_WEIGHTS[hardest] otherwise
+    float score = 0.0f;
+    SudokuTier tier = SudokuTier::Easy;
+    SudokuTechnique hardest = SudokuTechnique::CrossingOut;
+    // solver passes that placed numbers
+    uint8_t passes = 0;
+    // numbers placed by every SudokuTechnique
+    std::array<uint8_t, static_cast<size_t>(SudokuTechnique::Count)> placements = {};
+};
+
+// score = weight of the hardest technique used
+//       + PASS_WEIGHT per pass
+//       + PLACEMENT_WEIGHT * (weight - 1) per number placed by a technique
+//         harder than crossing out
+// The tier is the first one whose limit is above the score. Rating walks the
+// solution steps once and allocates nothing.
+class SudokuRater
+{
+public:
+    static constexpr std::array<float, static_cast<size_t>(SudokuTechnique::Count)> TECHNIQUE_WEIGHTS = {
+        1.0f, 1.1f, 1.3f, 2.0f, 3.0f, 3.2f, 3.4f, 3.6f, 3.8f, 4.2f, 4.5f, 5.0f
+    };
+    static constexpr float PASS_WEIGHT = 0.05f;
+    static constexpr float PLACEMENT_WEIGHT = 0.05f;
+    // upper score limits of Easy, Medium and Hard
+    static constexpr std::array<float, 3> TIER_LIMITS = { 1.6f, 2.5f, 4.0f };
+
+    // The result must come from SudokuSolver, a cache hit has no steps to rate
+    static SudokuRating Rate(const SudokuResult& result);
+    // Solves the sudoku in place and rates the solve
+    static SudokuRating Rate(Sudoku& sudoku, SudokuResult& result);
+
+    static SudokuTier Tier(float score);
+};
+
+#endif // SUDOKU_RATING_H
@@ -0,0 +1,118 @@
+#include "sudoku_schedule.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+void SudokuAdaptiveStrategy::Order(SudokuStageOrder& order)
+{
+    std::array<double, static_cast<size_t>(SudokuStage::Count)> costs;
+    for (size_t stage = 0; stage < costs.size(); ++stage)
+    {
+        costs[stage] = Cost(static_cast<SudokuStage>(stage));
+    }
+    // ties keep the order given
+    std::stable_sort(order.begin(), order.end(), [&costs](SudokuStage lhs, SudokuStage rhs) {
+        return costs[static_cast<size_t>(lhs)] < costs[static_cast<size_t>(rhs)];
+    });
+}
+
+void SudokuAdaptiveStrategy::Report(SudokuStage stage, uint64_t nanoseconds, bool placed)
+{
+    SudokuStageCounters& counters = m_stages[static_cast<size_t>(stage)];
+    counters.runs.fetch_add(1, std::memory_order_relaxed);
+    counters.placements.fetch_add(placed ? 1 : 0, std::memory_order_relaxed);
+    counters.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+SudokuAdaptiveStrategy::SudokuStageStats SudokuAdaptiveStrategy::Stats(SudokuStage stage) const
+{
+    const SudokuStageCounters& counters = m_stages[static_cast<size_t>(stage)];
+    SudokuStageStats stats;
+    stats.runs = counters.runs.load(std::memory_order_relaxed);
+    stats.placements = counters.placements.load(std::memory_order_relaxed);
+    stats.nanoseconds = counters.nanoseconds.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void SudokuAdaptiveStrategy::SetStats(SudokuStage stage, const SudokuStageStats& stats)
+{
+    SudokuStageCounters& counters = m_stages[static_cast<size_t>(stage)];
+    counters.runs.store(stats.runs, std::memory_order_relaxed);
+    counters.placements.store(stats.placements, std::memory_order_relaxed);
+    counters.nanoseconds.store(stats.nanoseconds, std::memory_order_relaxed);
+}
+
+double SudokuAdaptiveStrategy::Cost(SudokuStage stage) const
+{
+    const SudokuStageStats stats = Stats(stage);
+    const double runs = static_cast<double>(stats.runs) + 2.0;
+    const double time = (static_cast<double>(stats.nanoseconds) + 2.0 * PRIOR_NANOSECONDS) / runs;
+    const double yield = (static_cast<double>(stats.placements) + 1.0) / runs;
+    return time / yield;
+}
+
+bool SudokuAdaptiveStrategy::Load(const std::string& path)
+{
+    std::FILE* file = std::fopen(path.c_str(), "r");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    std::array<SudokuStageStats, static_cast<size_t>(SudokuStage::Count)> loaded;
+    char name[32];
+    unsigned long long runs = 0;
+    unsigned long long placements = 0;
+    unsigned long long nanoseconds = 0;
+    bool valid = true;
+    int fields = 0;
+    while (valid && (fields = std::fscanf(file, "%31s %llu %llu %llu", name, &runs, &placements, &nanoseconds)) == 4)
+    {
+        size_t stage = 0;
+        while (stage < loaded.size() && std::strcmp(name, StageName(static_cast<SudokuStage>(stage))) != 0)
+        {
+            ++stage;
+        }
+        valid = stage < loaded.size() && placements <= runs;
+        if (valid)
+        {
+            loaded[stage] = { runs, placements, nanoseconds };
+        }
+    }
+    std::fclose(file);
+    if (!valid || fields != EOF)
+    {
+        throw std::invalid_argument("Not a sudoku schedule file "s + path);
+    }
+
+    for (size_t stage = 0; stage < loaded.size(); ++stage)
+    {
+        SetStats(static_cast<SudokuStage>(stage), loaded[stage]);
+    }
+    return true;
+}
+
+void SudokuAdaptiveStrategy::Save(const std::string& path) const
+{
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (file == nullptr)
+    {
+        throw std::invalid_argument("Can't open file "s + path);
+    }
+    bool written = true;
+    for (size_t stage = 0; stage < m_stages.size(); ++stage)
+    {
+        const SudokuStageStats stats = Stats(static_cast<SudokuStage>(stage));
+        written = written && std::fprintf(file, "%s %llu %llu %llu\n", StageName(static_cast<SudokuStage>(stage)),
+            static_cast<unsigned long long>(stats.runs), static_cast<unsigned long long>(stats.placements),
+            static_cast<unsigned long long>(stats.nanoseconds)) > 0;
+    }
+    written = std::fclose(file) == 0 && written;
+    if (!written)
+    {
+        throw std::runtime_error("Can't write sudoku schedule file "s + path);
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef SUDOKU_SCHEDULE_H
+#define SUDOKU_SCHEDULE_H
+
+#include "sudoku.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Learns the order of the stages from the puzzles it sees. A stage that
+// places numbers in a share p of its runs and takes t ns per run costs
+// t / p ns per placement, and trying the stages by ascending t / p gives
+// the least expected time to the next placement. The counts start from a
+// prior that is the same for every stage, so the fixed order holds until
+// the stages have been measured. The counters are atomics, one strategy
+// serves every solver thread.
+class SudokuAdaptiveStrategy : public SudokuStrategy
+{
+public:
+    struct SudokuStageStats
+    {
+        uint64_t runs = 0;
+        uint64_t placements = 0;
+        uint64_t nanoseconds = 0;
+    };
+
+    // prior of every stage: one run of PRIOR_NANOSECONDS that placed and one that didn't
+    static constexpr double PRIOR_NANOSECONDS = 1000.0;
+
+    void Order(SudokuStageOrder& order) override;
+    void Report(SudokuStage stage, uint64_t nanoseconds, bool placed) override;
+
+    SudokuStageStats Stats(SudokuStage stage) const;
+    void SetStats(SudokuStage stage, const SudokuStageStats& stats);
+    // expected nanoseconds per placement
+    double Cost(SudokuStage stage) const;
+
+    // The statistics are kept as text, one "name runs placements nanoseconds"
+    // line per stage. Load returns false when the file can't be opened and
+    // throws std::invalid_argument on anything else it can't read.
+    bool Load(const std::string& path);
+    void Save(const std::string& path) const;
+
+private:
+    struct SudokuStageCounters
+    {
+        std::atomic<uint64_t> runs{ 0 };
+        std::atomic<uint64_t> placements{ 0 };
+        std::atomic<uint64_t> nanoseconds{ 0 };
+    };
+
+    std::array<SudokuStageCounters, static_cast<size_t>(SudokuStage::Count)> m_stages;
+};
+
+#endif // SUDOKU_SCHEDULE_H
@@ -0,0 +1,318 @@
+#include "sudoku_stream.h"
+
+#include "sudoku_binary.h"
+#include "sudoku_rating.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SUDOKU_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std::string_literals;
+
+namespace
+{
+constexpr size_t BUFFER_SIZE = 1 << 20;
+
+void AppendCells(const std::array<uint8_t, 81>& cells, std::string& text)
+{
+    for (uint8_t value : cells)
+    {
+        text += static_cast<char>('0' + value);
+    }
+}
+}
+
+SudokuLineReader::SudokuLineReader(const std::string& path)
+{
+    if (path == "-"s)
+    {
+        m_file = stdin;
+    }
+    else
+    {
+#ifdef SUDOKU_HAS_MMAP
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd >= 0 && fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+        {
+            void* map = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED)
+            {
+                madvise(map, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+                m_map = static_cast<const char*>(map);
+                m_map_size = static_cast<size_t>(info.st_size);
+            }
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        if (m_map != nullptr)
+        {
+            return;
+        }
+#endif
+        m_file = std::fopen(path.c_str(), "rb");
+        if (m_file == nullptr)
+        {
+            throw std::invalid_argument("Can't open file "s + path);
+        }
+        m_owns_file = true;
+    }
+    m_buffer.resize(BUFFER_SIZE);
+}
+
+SudokuLineReader::~SudokuLineReader()
+{
+#ifdef SUDOKU_HAS_MMAP
+    if (m_map != nullptr)
+    {
+        munmap(const_cast<char*>(m_map), m_map_size);
+    }
+#endif
+    if (m_owns_file)
+    {
+        std::fclose(m_file);
+    }
+}
+
+bool SudokuLineReader::NextLine(std::string_view& line)
+{
+    bool res = m_map != nullptr ? NextMappedLine(line) : NextBufferedLine(line);
+    if (res && !line.empty() && line.back() == '\r')
+    {
+        line.remove_suffix(1);
+    }
+    return res;
+}
+
+void SudokuLineReader::Release()
+{
+#ifdef SUDOKU_HAS_MMAP
+    if (m_map == nullptr)
+    {
+        return;
+    }
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t end = m_map_pos / page * page;
+    if (end > m_map_released)
+    {
+        madvise(const_cast<char*>(m_map) + m_map_released, end - m_map_released, MADV_DONTNEED);
+        m_map_released = end;
+    }
+#endif
+}
+
+bool SudokuLineReader::NextMappedLine(std::string_view& line)
+{
+    if (m_map_pos >= m_map_size)
+    {
+        return false;
+    }
+    const char* begin = m_map + m_map_pos;
+    const char* end = static_cast<const char*>(std::memchr(begin, '\n', m_map_size - m_map_pos));
+    if (end == nullptr)
+    {
+        end = m_map + m_map_size;
+    }
+    line = std::string_view(begin, static_cast<size_t>(end - begin));
+    m_map_pos = static_cast<size_t>(end - m_map) + 1;
+    return true;
+}
+
+bool SudokuLineReader::NextBufferedLine(std::string_view& line)
+{
+    while (true)
+    {
+        const char* begin = m_buffer.data() + m_buffer_begin;
+        const size_t size = m_buffer_end - m_buffer_begin;
+        const char* end = static_cast<const char*>(std::memchr(begin, '\n', size));
+        if (end != nullptr)
+        {
+            line = std::string_view(begin, static_cast<size_t>(end - begin));
+            m_buffer_begin += line.size() + 1;
+            return true;
+        }
+        if (m_eof)
+        {
+            if (size == 0)
+            {
+                return false;
+            }
+            line = std::string_view(begin, size);
+            m_buffer_begin = m_buffer_end;
+            return true;
+        }
+
+        // keep the incomplete line and refill the rest of the buffer
+        std::memmove(m_buffer.data(), begin, size);
+        m_buffer_begin = 0;
+        m_buffer_end = size;
+        if (m_buffer_end == m_buffer.size())
+        {
+            // no sudoku line is this long, hand it over as it is
+            line = std::string_view(m_buffer.data(), m_buffer_end);
+            m_buffer_begin = m_buffer_end;
+            return true;
+        }
+        const size_t count = std::fread(m_buffer.data() + m_buffer_end, 1, m_buffer.size() - m_buffer_end, m_file);
+        m_buffer_end += count;
+        m_eof = count == 0;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+SudokuStreamSolver::SudokuStreamSolver(SudokuBatchSolver& batch, size_t chunk_size)
+    : m_batch(batch), m_chunk_size(std::max<size_t>(chunk_size, 1))
+{
+}
+
+SudokuStreamStats SudokuStreamSolver::Run(SudokuLineReader& reader, std::ostream& out, std::ostream& err)
+{
+    return RunChunks(reader, out, err);
+}
+
+SudokuStreamStats SudokuStreamSolver::Run(const SudokuBinaryFile& file, std::ostream& out, std::ostream& err)
+{
+    return RunChunks(file, out, err);
+}
+
+template <typename Source>
+SudokuStreamStats SudokuStreamSolver::RunChunks(Source& source, std::ostream& out, std::ostream& err)
+{
+    SudokuStreamStats stats;
+    SudokuStreamChunk chunks[2];
+    std::future<void> writing;
+    for (int current = 0; ReadChunk(source, chunks[current], stats); current ^= 1)
+    {
+        SudokuStreamChunk& chunk = chunks[current];
+        chunk.results.resize(chunk.sudokus.size());
+        m_batch.Solve(chunk.sudokus.data(), chunk.results.data(), chunk.sudokus.size());
+
+        if (writing.valid())
+        {
+            writing.get();
+        }
+        writing = std::async(std::launch::async, [this, &chunk, &out, &err, &stats]() {
+            FormatChunk(chunk, err, stats);
+            out.write(chunk.text.data(), static_cast<std::streamsize>(chunk.text.size()));
+        });
+    }
+    if (writing.valid())
+    {
+        writing.get();
+    }
+    out.flush();
+    return stats;
+}
+
+bool SudokuStreamSolver::ReadChunk(SudokuLineReader& reader, SudokuStreamChunk& chunk, SudokuStreamStats& stats)
+{
+    chunk.lines.clear();
+    chunk.sudokus.clear();
+    chunk.inputs.clear();
+    chunk.rejected.clear();
+
+    SudokuGrid grid;
+    std::string_view line;
+    while (chunk.lines.size() < m_chunk_size && reader.NextLine(line))
+    {
+        ++stats.lines;
+        if (line.empty())
+        {
+            continue;
+        }
+        const SudokuValid parsed = grid.TryFillGrid(line);
+        if (parsed)
+        {
+            chunk.lines.push_back({ stats.lines, parsed, chunk.sudokus.size() });
+            chunk.sudokus.emplace_back(grid);
+            chunk.inputs += line;
+        }
+        else
+        {
+            chunk.lines.push_back({ stats.lines, parsed, chunk.rejected.size() });
+            chunk.rejected.emplace_back(line);
+        }
+    }
+    reader.Release();
+    return !chunk.lines.empty();
+}
+
+bool SudokuStreamSolver::ReadChunk(const SudokuBinaryFile& file, SudokuStreamChunk& chunk, SudokuStreamStats& stats)
+{
+    chunk.lines.clear();
+    chunk.sudokus.clear();
+    chunk.inputs.clear();
+    chunk.rejected.clear();
+
+    // records are numbered like lines, from 1
+    std::array<uint8_t, 81> cells;
+    while (chunk.lines.size() < m_chunk_size && stats.lines < file.Size())
+    {
+        UnpackCells(file.PackedPuzzle(stats.lines), cells.data());
+        ++stats.lines;
+        chunk.sudokus.emplace_back();
+        const SudokuValid parsed = chunk.sudokus.back().TryFillGrid(cells.data(), cells.size());
+        if (parsed)
+        {
+            chunk.lines.push_back({ stats.lines, parsed, chunk.sudokus.size() - 1 });
+            AppendCells(cells, chunk.inputs);
+        }
+        else
+        {
+            chunk.sudokus.pop_back();
+            chunk.lines.push_back({ stats.lines, parsed, chunk.rejected.size() });
+            chunk.rejected.emplace_back();
+            AppendCells(cells, chunk.rejected.back());
+        }
+    }
+    return !chunk.lines.empty();
+}
+
+void SudokuStreamSolver::FormatChunk(SudokuStreamChunk& chunk, std::ostream& err, SudokuStreamStats& stats) const
+{
+    chunk.text.clear();
+    for (const SudokuStreamLine& line : chunk.lines)
+    {
+        if (!line.parsed)
+        {
+            ++stats.failed;
+            err << "Line "s << line.number << ": "s << line.parsed << std::endl;
+            chunk.text += chunk.rejected[line.index];
+            chunk.text += '\n';
+            continue;
+        }
+        const SudokuResult& result = chunk.results[line.index];
+        if (!result)
+        {
+            ++stats.failed;
+            err << "Line "s << line.number << ": "s << result.valid << std::endl;
+            chunk.text.append(chunk.inputs, line.index * 81, 81);
+            chunk.text += '\n';
+            continue;
+        }
+        ++stats.solved;
+        AppendCells(chunk.sudokus[line.index].Values(), chunk.text);
+        if (m_rating)
+        {
+            const SudokuRating rating = SudokuRater::Rate(result);
+            char score[16];
+            std::snprintf(score, sizeof(score), " %.2f ", rating.score);
+            chunk.text += score;
+            chunk.text += TierName(rating.tier);
+        }
+        chunk.text += '\n';
+    }
+}
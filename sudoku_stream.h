@@ -0,0 +1,119 @@
+#ifndef SUDOKU_STREAM_H
+#define SUDOKU_STREAM_H
+
+#include "sudoku.h"
+#include "sudoku_batch.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Splits a file or stdin into lines without loading it whole.
+// Regular files are memory-mapped (pages that were consumed are released),
+// stdin and other streams are read through a fixed-size buffer.
+class SudokuLineReader
+{
+public:
+    // "-" reads stdin
+    explicit SudokuLineReader(const std::string& path);
+    ~SudokuLineReader();
+
+    SudokuLineReader(const SudokuLineReader&) = delete;
+    SudokuLineReader& operator=(const SudokuLineReader&) = delete;
+
+    // The line stays valid until the next call
+    bool NextLine(std::string_view& line);
+
+    // Lets the reader drop everything before the current line
+    void Release();
+
+private:
+    bool NextMappedLine(std::string_view& line);
+    bool NextBufferedLine(std::string_view& line);
+
+private:
+    std::FILE* m_file = nullptr;
+    bool m_owns_file = false;
+
+    const char* m_map = nullptr;
+    size_t m_map_size = 0;
+    size_t m_map_pos = 0;
+    size_t m_map_released = 0;
+
+    std::vector<char> m_buffer;
+    size_t m_buffer_begin = 0;
+    size_t m_buffer_end = 0;
+    bool m_eof = false;
+};
+
+// ----------------------------------------------------------------------------
+
+class SudokuBinaryFile;
+
+struct SudokuStreamStats
+{
+    size_t lines = 0;
+    size_t solved = 0;
+    size_t failed = 0;
+};
+
+// Reads puzzles in the one-line 81-character format ('.' or '0' for blanks)
+// and writes the solutions in input order. Puzzles are solved chunk by chunk
+// on the batch solver while the previous chunk is being written, so memory
+// stays bounded by two chunks whatever the input size.
+// Lines that can't be parsed or solved are echoed unchanged and reported to
+// the error stream.
+class SudokuStreamSolver
+{
+public:
+    explicit SudokuStreamSolver(SudokuBatchSolver& batch, size_t chunk_size = 4096);
+
+    // Appends the difficulty score and tier to every solution line, the
+    // batch solves for the rating meanwhile
+    void SetRating(bool rating)
+    {
+        m_rating = rating;
+        m_batch.SetRating(rating);
+    }
+
+    SudokuStreamStats Run(SudokuLineReader& reader, std::ostream& out, std::ostream& err = std::cerr);
+    // packed puzzles are loaded without text parsing, records are numbered as lines
+    SudokuStreamStats Run(const SudokuBinaryFile& file, std::ostream& out, std::ostream& err = std::cerr);
+
+private:
+    struct SudokuStreamLine
+    {
+        size_t number;
+        // the parse error of a rejected line
+        SudokuValid parsed;
+        // index in sudokus when parsed, otherwise in rejected
+        size_t index;
+    };
+
+    struct SudokuStreamChunk
+    {
+        std::vector<SudokuStreamLine> lines;
+        std::vector<Sudoku> sudokus;
+        std::vector<SudokuResult> results;
+        // 81 characters per sudoku, echoed when it can't be solved
+        std::string inputs;
+        std::vector<std::string> rejected;
+        std::string text;
+    };
+
+    template <typename Source>
+    SudokuStreamStats RunChunks(Source& source, std::ostream& out, std::ostream& err);
+    bool ReadChunk(SudokuLineReader& reader, SudokuStreamChunk& chunk, SudokuStreamStats& stats);
+    bool ReadChunk(const SudokuBinaryFile& file, SudokuStreamChunk& chunk, SudokuStreamStats& stats);
+    void FormatChunk(SudokuStreamChunk& chunk, std::ostream& err, SudokuStreamStats& stats) const;
+
+private:
+    SudokuBatchSolver& m_batch;
+    size_t m_chunk_size;
+    bool m_rating = false;
+};
+
+#endif // SUDOKU_STREAM_H
@@ -1,13 +1,41 @@
 #include "sudoku_test.h"
 
 #include "sudoku.h"
-
+#include "sudoku_batch.h"
+#include "sudoku_binary.h"
+#include "sudoku_cache.h"
+#include "sudoku_metrics.h"
+#include "sudoku_rating.h"
+#include "sudoku_schedule.h"
+#include "sudoku_trace.h"
+#include "sudoku_validity.h"
+
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
 #include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 using namespace std::string_literals;
 
+// Prints the failed condition and aborts, in release builds as well
+#define SUDOKU_CHECK(...)                                                                                  \
+    do                                                                                                     \
+    {                                                                                                      \
+        if (!(__VA_ARGS__))                                                                                \
+        {                                                                                                  \
+            std::cout << __FILE__ << ":"s << __LINE__ << ": "s << #__VA_ARGS__ << " failed"s << std::endl; \
+            abort();                                                                                       \
+        }                                                                                                  \
+    } while (false)
+
 // easy: http://www.sudoku-download.net/files/60_Sudokus_Easy.pdf
 // esty solutions: http://www.sudoku-download.net/files/Solution_60_Sudokus_Easy.pdf
 
@@ -688,12 +716,48 @@ static SudokuTest::SudokuTestData data_extream = {
     }
 };
 
+const SudokuTest::SudokuTestData& SudokuTest::DataEasy()
+{
+    return data_easy;
+}
+
+const SudokuTest::SudokuTestData& SudokuTest::DataMedium()
+{
+    return data_medium;
+}
+
+const SudokuTest::SudokuTestData& SudokuTest::DataHard()
+{
+    return data_hard;
+}
+
+const SudokuTest::SudokuTestData& SudokuTest::DataExtream()
+{
+    return data_extream;
+}
+
 void SudokuTest::TestSudoku()
 {
     TestSudokuEasy();
     TestSudokuMedium();
     TestSudokuHard();
     TestSudokuExtream();
+    TestSudokuSearch();
+    TestSudokuBatch();
+    TestSudokuValidity();
+    TestSudokuBatchValidity();
+    TestSudokuParse();
+    TestSudokuBinary();
+    TestSudokuCache();
+    TestSudokuRating();
+    TestSudokuCandidates();
+    TestSudokuPopularity();
+    TestSudokuSchedule();
+    TestSudokuMetrics();
+    TestSudokuTrace();
+#ifdef SUDOKU_STATS
+    TestSudokuStats();
+#endif
 }
 
 void SudokuTest::TestSudokuEasy()
@@ -716,6 +780,968 @@ void SudokuTest::TestSudokuExtream()
     TestSudokuLocalData(data_extream, "TestSudokuExtream"s);
 }
 
+void SudokuTest::TestSudokuSearch()
+{
+    // needs more than the box techniques: used to throw after 25 passes
+    const SudokuInput arto_inkala = {
+        8,0,0, 0,0,0, 0,0,0,
+        0,0,3, 6,0,0, 0,0,0,
+        0,7,0, 0,9,0, 2,0,0,
+
+        0,5,0, 0,0,7, 0,0,0,
+        0,0,0, 0,4,5, 7,0,0,
+        0,0,0, 1,0,0, 0,3,0,
+
+        0,0,1, 0,0,0, 0,6,8,
+        0,0,8, 5,0,0, 0,1,0,
+        0,9,0, 0,0,0, 4,0,0
+    };
+    const SudokuInput arto_inkala_solved = {
+        8,1,2, 7,5,3, 6,4,9,
+        9,4,3, 6,8,2, 1,7,5,
+        6,7,5, 4,9,1, 2,8,3,
+
+        1,5,4, 2,3,7, 8,9,6,
+        3,6,9, 8,4,5, 7,2,1,
+        2,8,7, 1,6,9, 5,3,4,
+
+        5,2,1, 9,7,4, 3,6,8,
+        4,3,8, 5,2,6, 9,1,7,
+        7,9,6, 3,1,8, 4,5,2
+    };
+    TestSudokuLocalData({ { arto_inkala, arto_inkala_solved } }, "TestSudokuSearchHard"s);
+
+    // every cell of the empty grid is filled with some valid solution
+    Sudoku empty(SudokuInput(81, 0));
+    SudokuSolver empty_solver(empty);
+    SudokuResult empty_result = empty_solver.Solve();
+    SUDOKU_CHECK(empty_result);
+    SUDOKU_CHECK(std::count(empty.Values().begin(), empty.Values().end(), 0) == 0);
+
+    // consistent givens, but the cell (0, 8) has no candidate left
+    SudokuInput no_solution(81, 0);
+    for (int col = 0; col < 8; ++col)
+    {
+        no_solution[col] = col + 1;
+    }
+    no_solution[9 * 4 + 8] = 9;
+    Sudoku unsolvable(no_solution);
+    SudokuSolver unsolvable_solver(unsolvable);
+    SUDOKU_CHECK(!unsolvable_solver.Solve());
+
+    std::cout << "TestSudokuSearch Ok"s << std::endl;
+}
+
+void SudokuTest::TestSudokuBatch()
+{
+    std::vector<Sudoku> inputs;
+    std::vector<Sudoku> solved;
+    for (const SudokuTestData* data : { &data_easy, &data_medium, &data_hard, &data_extream })
+    {
+        for (const auto& [input_data, solved_data] : *data)
+        {
+            inputs.emplace_back(input_data);
+            solved.emplace_back(solved_data);
+        }
+    }
+
+    for (size_t thread_count : { 1, 4 })
+    {
+        std::vector<Sudoku> sudokus = inputs;
+        SudokuBatchSolver batch(thread_count);
+        std::vector<SudokuResult> results = batch.Solve(sudokus);
+        SUDOKU_CHECK(results.size() == sudokus.size());
+        for (size_t i = 0; i < sudokus.size(); ++i)
+        {
+            if (!results[i] || sudokus[i] != solved[i]) {
+                std::cout << results[i] << sudokus[i] << std::endl;
+                abort();
+            }
+        }
+        // the pool is reused for the next batch
+        sudokus = inputs;
+        results = batch.Solve(sudokus);
+        SUDOKU_CHECK(std::equal(sudokus.begin(), sudokus.end(), solved.begin()));
+    }
+    std::cout << "TestSudokuBatch Ok"s << std::endl;
+}
+
+void SudokuTest::TestSudokuValidity()
+{
+    // keystrokes on a solved grid: the incremental state must match a full rescan
+    Sudoku sudoku(data_easy.front().second);
+    SUDOKU_CHECK(sudoku.IsComplete());
+
+    std::mt19937 generator(2021);
+    std::uniform_int_distribution<int> cells(0, 8);
+    std::uniform_int_distribution<int> numbers(0, 9);
+    for (int keystroke = 0; keystroke < 5000; ++keystroke)
+    {
+        sudoku.PutNumber(cells(generator), cells(generator), numbers(generator));
+
+        const Sudoku rescanned(std::vector<int>(sudoku.Values().begin(), sudoku.Values().end()));
+        const bool valid = SudokuCheckValidity::IsSudokuValid(sudoku);
+        const bool filled = std::count(sudoku.Values().begin(), sudoku.Values().end(), 0) == 0;
+        SUDOKU_CHECK(sudoku.IsConsistent() == valid);
+        SUDOKU_CHECK(sudoku.IsComplete() == (valid && filled));
+        SUDOKU_CHECK(static_cast<bool>(sudoku.IsSudokuValid()) == valid);
+        for (const SudokuSquare& square : Sudoku::Squares())
+        {
+            for (int number = 1; number <= 9; ++number)
+            {
+                SUDOKU_CHECK(sudoku.HasSquareNumber(square, number) == rescanned.HasSquareNumber(square, number));
+                SUDOKU_CHECK(sudoku.HasRowNumber(square.row_begin + square.col, number) ==
+                    rescanned.HasRowNumber(square.row_begin + square.col, number));
+                SUDOKU_CHECK(sudoku.HasColNumber(square.col_begin + square.row, number) ==
+                    rescanned.HasColNumber(square.col_begin + square.row, number));
+                SUDOKU_CHECK(sudoku.AvailableRows(number, square) == rescanned.AvailableRows(number, square));
+                SUDOKU_CHECK(sudoku.AvailableCols(number, square) == rescanned.AvailableCols(number, square));
+            }
+        }
+    }
+
+    // the error is reported as codes, the text is built on demand
+    Sudoku duplicate(data_easy.front().second);
+    const int number = duplicate(0, 0);
+    duplicate.PutNumber(0, 1, number);
+    const SudokuValid valid = duplicate.IsSudokuValid();
+    SUDOKU_CHECK(!valid && valid.error == SudokuError::Duplicate);
+    SUDOKU_CHECK(valid.unit == SudokuUnit::Row && valid.index == 0 && valid.number == number);
+    SUDOKU_CHECK(valid.Text() == "Number "s + std::to_string(number) + " has appeared in the row 0 at least twice"s);
+    SUDOKU_CHECK(SudokuValid().Text().empty());
+    std::cout << "TestSudokuValidity Ok"s << std::endl;
+}
+
+void SudokuTest::TestSudokuBatchValidity()
+{
+    // solved grids, puzzles and random keystrokes on them, packed 81 bytes apart
+    std::vector<uint8_t> grids;
+    for (const SudokuTestData* data : { &data_easy, &data_medium, &data_hard, &data_extream })
+    {
+        for (const auto& [input_data, solved_data] : *data)
+        {
+            grids.insert(grids.end(), input_data.begin(), input_data.end());
+            grids.insert(grids.end(), solved_data.begin(), solved_data.end());
+        }
+    }
+    std::mt19937 generator(2021);
+    std::uniform_int_distribution<size_t> cells(0, 80);
+    std::uniform_int_distribution<int> numbers(0, 9);
+    const size_t source_count = grids.size() / 81;
+    for (size_t source = 0; source < source_count * 3; ++source)
+    {
+        grids.insert(grids.end(), grids.begin() + (source % source_count) * 81,
+            grids.begin() + (source % source_count + 1) * 81);
+        grids[grids.size() - 81 + cells(generator)] = static_cast<uint8_t>(numbers(generator));
+    }
+    grids[grids.size() - 81 + cells(generator)] = 10;
+    grids[81 * 5 + cells(generator)] = 255;
+
+    const size_t count = grids.size() / 81;
+    std::vector<SudokuGridStatus> expected(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint8_t* grid = grids.data() + i * 81;
+        const SudokuValid valid = SudokuBatchValidity::Explain(grid);
+        if (std::any_of(grid, grid + 81, [](uint8_t value) { return value > 9; }))
+        {
+            SUDOKU_CHECK(valid.error == SudokuError::BadValue && valid.unit == SudokuUnit::Cell);
+            SUDOKU_CHECK(grid[valid.index] == valid.number);
+            expected[i] = SudokuGridStatus::BadValue;
+        }
+        else if (!valid)
+        {
+            expected[i] = SudokuGridStatus::Duplicate;
+        }
+        else
+        {
+            expected[i] = std::count(grid, grid + 81, 0) == 0 ? SudokuGridStatus::Complete
+                                                              : SudokuGridStatus::Incomplete;
+        }
+    }
+    SUDOKU_CHECK(std::count(expected.begin(), expected.end(), SudokuGridStatus::Duplicate) > 0);
+    SUDOKU_CHECK(std::count(expected.begin(), expected.end(), SudokuGridStatus::BadValue) == 2);
+
+    for (SudokuIsa isa : { SudokuIsa::Scalar, SudokuIsa::Ssse3, SudokuIsa::Avx2 })
+    {
+        std::vector<SudokuGridStatus> statuses(count);
+        SudokuBatchValidity::Validate(grids.data(), 81, count, statuses.data(), isa);
+        if (statuses != expected) {
+            std::cout << "SudokuBatchValidity::Validate failed with "s << IsaName(isa) << std::endl;
+            abort();
+        }
+    }
+
+    // solver grids are packed side by side as SudokuGrid records
+    std::vector<Sudoku> sudokus;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (expected[i] != SudokuGridStatus::BadValue)
+        {
+            sudokus.emplace_back(SudokuInput(grids.begin() + i * 81, grids.begin() + (i + 1) * 81));
+        }
+    }
+    const std::vector<SudokuGrid> packed(sudokus.begin(), sudokus.end());
+    std::vector<SudokuGridStatus> statuses(packed.size());
+    SudokuBatchValidity::Validate(packed.data(), packed.size(), statuses.data());
+    for (size_t i = 0; i < sudokus.size(); ++i)
+    {
+        SUDOKU_CHECK((statuses[i] != SudokuGridStatus::Duplicate) == sudokus[i].IsConsistent());
+        SUDOKU_CHECK((statuses[i] == SudokuGridStatus::Complete) == sudokus[i].IsComplete());
+    }
+    std::cout << "TestSudokuBatchValidity Ok"s << std::endl;
+}
+
+void SudokuTest::TestSudokuParse()
+{
+    for (const auto& [input_data, solved_data] : data_hard)
+    {
+        std::string line;
+        for (int value : input_data)
+        {
+            line += value == 0 ? '.' : static_cast<char>('0' + value);
+        }
+        SudokuGrid grid;
+        SUDOKU_CHECK(grid.TryFillGrid(line));
+        SUDOKU_CHECK(grid == SudokuGrid(input_data));
+
+        Sudoku sudoku;
+        SUDOKU_CHECK(sudoku.TryFillGrid(line));
+        const std::vector<uint8_t> bytes(input_data.begin(), input_data.end());
+        Sudoku from_bytes;
+        SUDOKU_CHECK(from_bytes.TryFillGrid(bytes.data(), bytes.size()));
+        const Sudoku expected(input_data);
+        for (const Sudoku* parsed : { &sudoku, &from_bytes })
+        {
+            SUDOKU_CHECK(*parsed == expected);
+            for (const SudokuSquare& square : Sudoku::Squares())
+            {
+                for (int number = 1; number <= 9; ++number)
+                {
+                    SUDOKU_CHECK(parsed->AvailableRows(number, square) == expected.AvailableRows(number, square));
+                }
+            }
+        }
+
+        // every position of the line goes through the fast path, the grid keeps its cells on error
+        for (int index = 0; index < 81; ++index)
+        {
+            for (char bad : { 'x', '/', ':', ' ', '\0', static_cast<char>(0xB1) })
+            {
+                std::string broken = line;
+                broken[index] = bad;
+                SudokuGrid unchanged(input_data);
+                const SudokuValid valid = unchanged.TryFillGrid(broken);
+                SUDOKU_CHECK(valid.error == SudokuError::BadCharacter && valid.unit == SudokuUnit::Cell);
+                SUDOKU_CHECK(valid.index == index && valid.number == static_cast<uint8_t>(bad));
+                SUDOKU_CHECK(unchanged == grid);
+            }
+        }
+        SUDOKU_CHECK(grid.TryFillGrid(std::string_view(line).substr(1)).error == SudokuError::WrongSize);
+        SUDOKU_CHECK(grid.TryFillGrid(line + "1"s).error == SudokuError::WrongSize);
+    }
+
+    std::vector<int> values(81, 0);
+    values[40] = 10;
+    SudokuGrid grid;
+    SudokuValid valid = grid.TryFillGrid(values);
+    SUDOKU_CHECK(valid.error == SudokuError::BadValue && valid.index == 40 && valid.number == 10);
+    values[40] = -1;
+    SUDOKU_CHECK(grid.TryFillGrid(values).error == SudokuError::BadValue);
+    SUDOKU_CHECK(grid.TryFillGrid(std::vector<int>(80, 0)).error == SudokuError::WrongSize);
+    bool thrown = false;
+    try
+    {
+        grid.FillGrid(values);
+    }
+    catch (const std::invalid_argument&)
+    {
+        thrown = true;
+    }
+    SUDOKU_CHECK(thrown);
+    std::cout << "TestSudokuParse Ok"s << std::endl;
+}
+
+void SudokuTest::TestSudokuBinary()
+{
+    const std::string path = (std::filesystem::temp_directory_path() / "sudoku_test_binary.bin"s).string();
+    size_t count = 0;
+    {
+        SudokuBinaryWriter writer(path, true);
+        for (const SudokuTestData* data : { &data_easy, &data_medium, &data_hard, &data_extream })
+        {
+            for (const auto& [input_data, solved_data] : *data)
+            {
+                writer.Add(SudokuGrid(input_data), SudokuGrid(solved_data));
+                ++count;
+            }
+        }
+        writer.Close();
+    }
+
+    {
+        SudokuBinaryFile file(path);
+        SUDOKU_CHECK(file.Size() == count && file.HasSolutions());
+        size_t index = 0;
+        for (const SudokuTestData* data : { &data_easy, &data_medium, &data_hard, &data_extream })
+        {
+            for (const auto& [input_data, solved_data] : *data)
+            {
+                Sudoku sudoku;
+                SudokuGrid solution;
+                SUDOKU_CHECK(file.LoadPuzzle(index, sudoku) && file.LoadSolution(index, solution));
+                SUDOKU_CHECK(sudoku == SudokuGrid(input_data) && solution == SudokuGrid(solved_data));
+                SudokuSolver solver(sudoku);
+                SUDOKU_CHECK(solver.Solve() && sudoku == solution);
+                ++index;
+            }
+        }
+
+        // nibbles above 9 are rejected on load
+        uint8_t packed[SUDOKU_PACKED_SIZE];
+        std::copy(file.PackedPuzzle(0), file.PackedPuzzle(0) + SUDOKU_PACKED_SIZE, packed);
+        packed[3] = static_cast<uint8_t>((packed[3] & 0x0F) | 0xC0);
+        SudokuGrid grid;
+        const SudokuValid valid = UnpackGrid(packed, grid);
+        SUDOKU_CHECK(valid.error == SudokuError::BadValue && valid.index == 7 && valid.number == 12);
+    }
+
+    // a header that promises more records than the file holds
+    std::filesystem::resize_file(path, SudokuBinaryFile::HEADER_SIZE + 2 * SUDOKU_PACKED_SIZE * count - 1);
+    bool thrown = false;
+    try
+    {
+        SudokuBinaryFile truncated(path);
+    }
+    catch (const std::invalid_argument&)
+    {
+        thrown = true;
+    }
+    SUDOKU_CHECK(thrown);
+    std::remove(path.c_str());
+    std::cout << "TestSudokuBinary Ok"s << std::endl;
+}
+
+void SudokuTest::TestSudokuCache()
+{
+    // a random element of the symmetry group
+    std::mt19937 generator(2021);
+    auto random_transform = [&generator]() {
+        SudokuTransform transform;
+        transform.transpose = generator() % 2 == 1;
+        std::array<uint8_t, 3> bands = { 0, 1, 2 };
+        std::array<uint8_t, 3> stacks = { 0, 1, 2 };
+        std::shuffle(bands.begin(), bands.end(), generator);
+        std::shuffle(stacks.begin(), stacks.end(), generator);
+        for (int k = 0; k < 3; ++k)
+        {
+            std::array<uint8_t, 3> rows = { 0, 1, 2 };
+            std::array<uint8_t, 3> cols = { 0, 1, 2 };
+            std::shuffle(rows.begin(), rows.end(), generator);
+            std::shuffle(cols.begin(), cols.end(), generator);
+            for (int i = 0; i < 3; ++i)
+            {
+                transform.rows[k * 3 + i] = static_cast<uint8_t>(bands[k] * 3 + rows[i]);
+                transform.cols[k * 3 + i] = static_cast<uint8_t>(stacks[k] * 3 + cols[i]);
+            }
+        }
+        std::array<uint8_t, 9> digits = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+        std::shuffle(digits.begin(), digits.end(), generator);
+        std::copy(digits.begin(), digits.end(), transform.labels.begin() + 1);
+        return transform;
+    };
+    auto transformed = [](const SudokuTransform& transform, const SudokuInput& input) {
+        const std::vector<uint8_t> cells(input.begin(), input.end());
+        std::vector<uint8_t> moved(81);
+        transform.Apply(cells.data(), moved.data());
+        return SudokuInput(moved.begin(), moved.end());
+    };
+
+    SudokuSolutionCache cache(1024, 4);
+    size_t solves = 0;
+    for (const SudokuTestData* data : { &data_easy, &data_medium, &data_hard, &data_extream })
+    {
+        for (const auto& [input_data, solved_data] : *data)
+        {
+            std::array<uint8_t, 81> key;
+            SudokuTransform transform;
+            SUDOKU_CHECK(SudokuCanonicalForm::Canonicalize(SudokuGrid(input_data), key, transform));
+            Sudoku first(input_data);
+            SudokuResult result;
+            cache.Solve(first, result);
+            SUDOKU_CHECK(result && first == SudokuGrid(solved_data));
+            ++solves;
+
+            for (int repeat = 0; repeat < 10; ++repeat)
+            {
+                const SudokuTransform moved = random_transform();
+                const SudokuInput moved_input = transformed(moved, input_data);
+                std::array<uint8_t, 81> moved_key;
+                SudokuTransform moved_transform;
+                SUDOKU_CHECK(SudokuCanonicalForm::Canonicalize(SudokuGrid(moved_input), moved_key, moved_transform));
+                SUDOKU_CHECK(moved_key == key);
+
+                // the stored solution comes back in the orientation of the repeat
+                Sudoku repeated(moved_input);
+                cache.Solve(repeated, result);
+                SUDOKU_CHECK(result && result.solution_steps.empty());
+                SUDOKU_CHECK(repeated == SudokuGrid(transformed(moved, solved_data)));
+                ++solves;
+            }
+        }
+    }
+    SUDOKU_CHECK(cache.Misses() == solves / 11 && cache.Hits() == solves - cache.Misses());
+
+    // one entry per puzzle, a full cache still holds every puzzle it was given
+    SudokuSolutionCache full_cache(data_hard.size(), 1);
+    for (int repeat = 0; repeat < 2; ++repeat)
+    {
+        for (const auto& [input_data, solved_data] : data_hard)
+        {
+            Sudoku repeated(transformed(random_transform(), input_data));
+            SudokuResult repeated_result;
+            full_cache.Solve(repeated, repeated_result);
+            SUDOKU_CHECK(repeated_result);
+        }
+    }
+    SUDOKU_CHECK(full_cache.Misses() == data_hard.size() && full_cache.Hits() == data_hard.size());
+
+    // too symmetric to canonicalize, solved without the cache
+    std::array<uint8_t, 81> key;
+    SudokuTransform transform;
+    SUDOKU_CHECK(!SudokuCanonicalForm::Canonicalize(SudokuGrid(SudokuInput(81, 0)), key, transform));
+    Sudoku empty;
+    SudokuResult result;
+    cache.Solve(empty, result);
+    SUDOKU_CHECK(result && empty.IsComplete());
+
+    // shared by the batch workers
+    std::vector<Sudoku> sudokus;
+    std::vector<Sudoku> solved;
+    for (int repeat = 0; repeat < 3; ++repeat)
+    {
+        for (const auto& [input_data, solved_data] : data_hard)
+        {
+            const SudokuTransform moved = random_transform();
+            sudokus.emplace_back(transformed(moved, input_data));
+            solved.emplace_back(transformed(moved, solved_data));
+        }
+    }
+    SudokuSolutionCache batch_cache(16, 2);
+    SudokuBatchSolver batch(4);
+    batch.SetCache(&batch_cache);
+    const std::vector<SudokuResult> results = batch.Solve(sudokus);
+    for (size_t i = 0; i < sudokus.size(); ++i)
+    {
+        SUDOKU_CHECK(results[i] && sudokus[i] == solved[i]);
+    }
+    std::cout << "TestSudokuCache Ok"s << std::endl;
+}
+
+void SudokuTest::TestSudokuRating()
+{
+    std::vector<float> mean_scores;
+    for (const SudokuTestData* data : { &data_easy, &data_medium, &data_hard, &data_extream })
+    {
+        float total = 0.0f;
+        for (const auto& [input_data, solved_data] : *data)
+        {
+            Sudoku sudoku(input_data);
+            SudokuResult result;
+            const SudokuRating rating = SudokuRater::Rate(sudoku, result);
+            SUDOKU_CHECK(result && sudoku == SudokuGrid(solved_data));
+            SUDOKU_CHECK(rating.passes == result.solution_steps.back().pass);
+            size_t placements = 0;
+            for (size_t technique = 0; technique < rating.placements.size(); ++technique)
+            {
+                placements += rating.placements[technique];
+                SUDOKU_CHECK(
+                    (rating.placements[technique] != 0) == result.Used(static_cast<SudokuTechnique>(technique)));
+            }
+            SUDOKU_CHECK(placements == result.solution_steps.size());
+            SUDOKU_CHECK(rating.score >= SudokuRater::TECHNIQUE_WEIGHTS[static_cast<size_t>(rating.hardest)]);
+            SUDOKU_CHECK(rating.tier == SudokuRater::Tier(rating.score));
+            if (data == &data_easy)
+            {
+                SUDOKU_CHECK(rating.tier == SudokuTier::Easy && rating.hardest == SudokuTechnique::CrossingOut);
+            }
+            total += rating.score;
+        }
+        mean_scores.push_back(total / data->size());
+    }
+    SUDOKU_CHECK(mean_scores[0] < mean_scores[1] && mean_scores[1] < mean_scores[3] && mean_scores[2] < mean_scores[3]);
+
+    // only the search solves it
+    Sudoku arto_inkala;
+    SUDOKU_CHECK(
+        arto_inkala.TryFillGrid("8..........36......7..9.2...5...7.......457.....1...3...1....68..85...1..9....4.."s));
+    SudokuResult result;
+    SudokuRating rating = SudokuRater::Rate(arto_inkala, result);
+    SUDOKU_CHECK(result && rating.hardest == SudokuTechnique::Search && rating.tier == SudokuTier::Extreme);
+
+    // nothing to place
+    rating = SudokuRater::Rate(arto_inkala, result);
+    SUDOKU_CHECK(result && rating.score == 0.0f && rating.passes == 0 && rating.tier == SudokuTier::Easy);
+
+    SUDOKU_CHECK(SudokuRater::Tier(SudokuRater::TIER_LIMITS[0] - 0.01f) == SudokuTier::Easy);
+    SUDOKU_CHECK(SudokuRater::Tier(SudokuRater::TIER_LIMITS[0]) == SudokuTier::Medium);
+    SUDOKU_CHECK(SudokuRater::Tier(SudokuRater::TIER_LIMITS[2]) == SudokuTier::Extreme);
+    SUDOKU_CHECK(TierName(SudokuTier::Hard) == "hard"s);
+    std::cout << "TestSudokuRating Ok"s << std::endl;
+}
+
+void SudokuTest::TestSudokuCandidates()
+{
+    // every reduction removes only numbers that can't be in the solution
+    auto check_sound = [](const Sudoku& puzzle, SudokuCandidates& candidates) {
+        SudokuSearch search(puzzle);
+        SUDOKU_CHECK(search.Run());
+        for (int index = 0; index < 81; ++index)
+        {
+            SUDOKU_CHECK(
+                puzzle.Cell(index) != 0 || (candidates.Cell(index) & (1u << (search(index / 9, index % 9) - 1))));
+        }
+    };
+
+    // the last technique each of these needs before the box techniques finish it
+    const std::pair<SudokuTechnique, std::string> lines[] = {
+        { SudokuTechnique::HiddenSingle, "..25.3....1..7...2.7.....5......5837.............2...67.....3...358421..2....9.4."s },
+        { SudokuTechnique::NakedSingle, ".59..37........2.1...87....9.....8....6..14.71.4....6..6.92..8....3.6...58......."s },
+        { SudokuTechnique::Pointing, "..1...47.........8...28..1....3..5..1....9.3..42..8..14.5.6....23..........7..6.5"s },
+        { SudokuTechnique::BoxLine, "..1.32....9......83..8...........71........9..53.91..654..8...77....3.642........"s },
+        { SudokuTechnique::NakedSubset, "8....54...3..87.....4.9..58..6.28..............29.453......2....6..59....4....3.1"s },
+        { SudokuTechnique::HiddenSubset, ".7.5.......28..61.5.3.4.9...1......4......89.72....5.......3...6........38..9.14."s },
+        { SudokuTechnique::Fish, ".1....3...8...6.1...9..4.5.1.2......3...4.......7..59........4.....3.7....69.528."s },
+        { SudokuTechnique::Coloring, "...81.597........6.....2...5...........19.7..71..3.6.4.8...5..36.1..4.58..7......"s },
+    };
+    for (const auto& [technique, line] : lines)
+    {
+        Sudoku sudoku;
+        SUDOKU_CHECK(sudoku.TryFillGrid(line));
+        SudokuCandidates candidates(sudoku);
+        while (candidates.ReducePointing() || candidates.ReduceBoxLine() || candidates.ReduceNakedSubsets() ||
+            candidates.ReduceHiddenSubsets() || candidates.ReduceFish() || candidates.ReduceColoring())
+        {
+            check_sound(sudoku, candidates);
+        }
+
+        Sudoku plain(sudoku);
+        SudokuSolver solver(sudoku);
+        solver.SetRating(true);
+        const SudokuResult result = solver.Solve();
+        SUDOKU_CHECK(result && sudoku.IsComplete());
+        SUDOKU_CHECK(result.Used(technique) && !result.Used(SudokuTechnique::Search));
+
+        // without a rating the search takes over from box-line reduction
+        const SudokuResult plain_result = SudokuSolver(plain).Solve();
+        SUDOKU_CHECK(plain_result && plain == sudoku);
+        SUDOKU_CHECK(technique <= SudokuTechnique::BoxLine || !plain_result.Used(technique));
+    }
+
+    // every single the candidates hold was taken, before or after the changes
+    std::array<SudokuCandidates::SudokuSingle, 81 * 2> singles;
+    auto take_singles = [&singles](SudokuCandidates& candidates, std::array<uint16_t, 81>& taken) {
+        for (size_t count = candidates.TakeSingles(singles); count != 0; count = candidates.TakeSingles(singles))
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                taken[singles[i].cell] |= static_cast<uint16_t>(1u << (singles[i].number - 1));
+            }
+        }
+    };
+
+    // placements keep the candidates of the peers in sync
+    for (const SudokuTestData* data : { &data_easy, &data_hard, &data_extream })
+    {
+        for (const auto& [input_data, solved_data] : *data)
+        {
+            const Sudoku puzzle(input_data);
+            SudokuCandidates candidates(puzzle);
+            std::array<uint16_t, 81> taken = {};
+            take_singles(candidates, taken);
+            Sudoku sudoku = puzzle;
+            for (int index = 0; index < 40; ++index)
+            {
+                if (sudoku.Cell(index) == 0)
+                {
+                    sudoku.PutNumber(index / 9, index % 9, solved_data[index]);
+                    candidates.Place(index, solved_data[index]);
+                }
+            }
+            SudokuCandidates rebuilt(sudoku);
+            for (int index = 0; index < 81; ++index)
+            {
+                SUDOKU_CHECK(candidates.Cell(index) == rebuilt.Cell(index));
+            }
+            check_sound(sudoku, candidates);
+
+            std::array<uint16_t, 81> rebuilt_taken = {};
+            take_singles(candidates, taken);
+            take_singles(rebuilt, rebuilt_taken);
+            for (int index = 0; index < 81; ++index)
+            {
+                SUDOKU_CHECK((rebuilt_taken[index] & ~taken[index]) == 0);
+            }
+        }
+    }
+    std::cout << "TestSudokuCandidates Ok"s << std::endl;
+}
+
+void SudokuTest::TestSudokuPopularity()
+{
+    auto order = [](const SudokuPopularity& popularity) {
+        std::vector<std::pair<int, int>> numbers(popularity.begin(), popularity.end());
+        return numbers;
+    };
+
+    // 7 twice, 3 and 5 once; ties go by number
+    Sudoku sudoku;
+    SUDOKU_CHECK(sudoku.TryFillGrid("7.......3.......7.........5"s + std::string(54, '.')));
+    SudokuPopularity popularity(sudoku);
+    popularity.SortPopularity();
+    SUDOKU_CHECK(order(popularity) == (std::vector<std::pair<int, int>>{
+        { 7, 2 }, { 3, 1 }, { 5, 1 }, { 1, 0 }, { 2, 0 }, { 4, 0 }, { 6, 0 }, { 8, 0 }, { 9, 0 } }));
+
+    // the snapshot keeps its order until the next pass
+    popularity.IncreasePolularity(9);
+    popularity.IncreasePolularity(9);
+    popularity.IncreasePolularity(9);
+    SUDOKU_CHECK(popularity.begin()->first == 7);
+    popularity.SortPopularity();
+    SUDOKU_CHECK(popularity.begin()->first == 9 && popularity.begin()->second == 3);
+
+    // completed numbers leave the order
+    for (int count = 3; count < 9; ++count)
+    {
+        popularity.IncreasePolularity(9);
+    }
+    popularity.SortPopularity();
+    SUDOKU_CHECK(order(popularity).size() == 8 && popularity.begin()->first == 7 && !popularity.IsEmpty());
+
+    // reused for a solved grid, nothing is left
+    const SudokuTestData& data = DataEasy();
+    popularity.Reset(Sudoku(data.front().second));
+    popularity.SortPopularity();
+    SUDOKU_CHECK(popularity.IsEmpty() && popularity.begin() == popularity.end());
+    std::cout << "TestSudokuPopularity Ok"s << std::endl;
+}
+
+void SudokuTest::TestSudokuSchedule()
+{
+    // runs the stages in reverse and keeps what it hears
+    struct SudokuReversedStrategy : SudokuStrategy
+    {
+        void Order(SudokuStageOrder& order) override
+        {
+            SUDOKU_CHECK(order == FIXED_ORDER);
+            std::reverse(order.begin(), order.end());
+        }
+
+        void Report(SudokuStage stage, uint64_t, bool placed) override
+        {
+            // a stage only runs after the ones before it placed nothing
+            SUDOKU_CHECK(last_placed || stage < last_stage || last_stage == SudokuStage::Count);
+            last_stage = stage;
+            last_placed = placed;
+            ++runs[static_cast<size_t>(stage)];
+        }
+
+        SudokuStage last_stage = SudokuStage::Count;
+        bool last_placed = true;
+        std::array<size_t, static_cast<size_t>(SudokuStage::Count)> runs = {};
+    };
+
+    // the singles stall on these
+    const std::string lines[] = {
+        "..1...47.........8...28..1....3..5..1....9.3..42..8..14.5.6....23..........7..6.5"s,
+        ".1....3...8...6.1...9..4.5.1.2......3...4.......7..59........4.....3.7....69.528."s,
+        "8..........36......7..9.2...5...7.......457.....1...3...1....68..85...1..9....4.."s,
+    };
+    SudokuReversedStrategy reversed;
+    for (const std::string& line : lines)
+    {
+        Sudoku sudoku;
+        SUDOKU_CHECK(sudoku.TryFillGrid(line));
+        SudokuSearch search(sudoku);
+        SUDOKU_CHECK(search.Run());
+        SudokuSolver solver(sudoku);
+        solver.SetStrategy(&reversed);
+        SudokuResult result;
+        solver.Solve(result);
+        SUDOKU_CHECK(result && sudoku.IsComplete());
+        for (int index = 0; index < 81; ++index)
+        {
+            SUDOKU_CHECK(sudoku.Cell(index) == search(index / 9, index % 9));
+        }
+        reversed.last_stage = SudokuStage::Count;
+        reversed.last_placed = true;
+    }
+    for (size_t runs : reversed.runs)
+    {
+        SUDOKU_CHECK(runs > 0);
+    }
+
+    // no measurements keep the fixed order, a stage that costs more per
+    // placement goes after a cheaper one
+    SudokuAdaptiveStrategy adaptive;
+    SudokuStrategy::SudokuStageOrder order = SudokuStrategy::FIXED_ORDER;
+    adaptive.Order(order);
+    SUDOKU_CHECK(order == SudokuStrategy::FIXED_ORDER);
+    adaptive.SetStats(SudokuStage::DoubleGuess, { 1000, 10, 2000000 });
+    adaptive.SetStats(SudokuStage::TripleGuess, { 1000, 10, 3000000 });
+    adaptive.SetStats(SudokuStage::Candidates, { 1000, 600, 20000000 });
+    adaptive.Report(SudokuStage::Candidates, 10000, true);
+    SUDOKU_CHECK(adaptive.Stats(SudokuStage::Candidates).runs == 1001 &&
+        adaptive.Stats(SudokuStage::Candidates).placements == 601);
+    SUDOKU_CHECK(adaptive.Cost(SudokuStage::Candidates) < adaptive.Cost(SudokuStage::DoubleGuess));
+    order = SudokuStrategy::FIXED_ORDER;
+    adaptive.Order(order);
+    SUDOKU_CHECK((order == SudokuStrategy::SudokuStageOrder{
+        SudokuStage::Candidates, SudokuStage::DoubleGuess, SudokuStage::TripleGuess }));
+
+    // the statistics survive a round trip through a file
+    const std::string path = (std::filesystem::temp_directory_path() / "sudoku_test_schedule.txt"s).string();
+    adaptive.Save(path);
+    SudokuAdaptiveStrategy loaded;
+    SUDOKU_CHECK(loaded.Load(path));
+    for (size_t stage = 0; stage < static_cast<size_t>(SudokuStage::Count); ++stage)
+    {
+        const auto saved_stats = adaptive.Stats(static_cast<SudokuStage>(stage));
+        const auto loaded_stats = loaded.Stats(static_cast<SudokuStage>(stage));
+        SUDOKU_CHECK(saved_stats.runs == loaded_stats.runs && saved_stats.placements == loaded_stats.placements &&
+            saved_stats.nanoseconds == loaded_stats.nanoseconds);
+    }
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    std::fputs("candidates 10 20 30\n", file);
+    std::fclose(file);
+    bool thrown = false;
+    try
+    {
+        loaded.Load(path);
+    }
+    catch (const std::invalid_argument&)
+    {
+        thrown = true;
+    }
+    SUDOKU_CHECK(thrown && loaded.Stats(SudokuStage::Candidates).runs == 1001);
+    std::remove(path.c_str());
+    SUDOKU_CHECK(!loaded.Load(path));
+
+    // a batch shares one strategy between its threads
+    std::vector<Sudoku> sudokus;
+    for (const auto& [input_data, solved_data] : data_hard)
+    {
+        sudokus.emplace_back(input_data);
+    }
+    SudokuBatchSolver batch(4);
+    SudokuAdaptiveStrategy shared;
+    batch.SetStrategy(&shared);
+    const std::vector<SudokuResult> results = batch.Solve(sudokus);
+    for (size_t i = 0; i < sudokus.size(); ++i)
+    {
+        SUDOKU_CHECK(results[i] && sudokus[i] == SudokuGrid(data_hard[i].second));
+    }
+    std::cout << "TestSudokuSchedule Ok"s << std::endl;
+}
+
+void SudokuTest::TestSudokuMetrics()
+{
+    // every bucket holds the values from its lowest up to the next bucket's
+    for (size_t bucket = 0; bucket < SudokuHistogram::BUCKETS; ++bucket)
+    {
+        SUDOKU_CHECK(SudokuHistogram::Bucket(SudokuHistogram::Lowest(bucket)) == bucket);
+        SUDOKU_CHECK(SudokuHistogram::Bucket(SudokuHistogram::Lowest(bucket + 1) - 1) == bucket);
+        SUDOKU_CHECK(SudokuHistogram::Lowest(bucket + 1) - SudokuHistogram::Lowest(bucket) <=
+            std::max<uint64_t>(1, SudokuHistogram::Lowest(bucket) / SudokuHistogram::SUB_BUCKETS));
+    }
+    SUDOKU_CHECK(SudokuHistogram::Bucket(~0ull) == SudokuHistogram::BUCKETS - 1);
+    SudokuHistogram histogram;
+    for (uint64_t value = 1; value <= 1000; ++value)
+    {
+        histogram.Add(value * 1000);
+    }
+    SUDOKU_CHECK(histogram.Count() == 1000 && histogram.Sum() == 500500000);
+    SUDOKU_CHECK(histogram.Percentile(50.0) >= 500000 && histogram.Percentile(50.0) <= 500000 * 9 / 8);
+    SUDOKU_CHECK(histogram.Percentile(100.0) >= 1000000 && histogram.Percentile(100.0) <= 1000000 * 9 / 8);
+    SUDOKU_CHECK(histogram.CountBelow(1 << 9) == 0 && histogram.CountBelow(1 << 10) == 1 &&
+        histogram.CountBelow(1 << 20) == 1000);
+
+    // a batch with the cache: one broken grid, the puzzles, then the puzzles
+    // again from the cache
+    std::vector<Sudoku> sudokus;
+    for (const auto& [input_data, solved_data] : data_hard)
+    {
+        sudokus.emplace_back(input_data);
+    }
+    std::vector<int> broken = data_hard[0].first;
+    broken[1] = broken[0] = 5;
+    sudokus.emplace_back(broken);
+    const std::vector<Sudoku> puzzles = sudokus;
+    SudokuSolutionCache cache(64);
+    SudokuMetrics metrics;
+    metrics.SetCache(&cache);
+    SudokuBatchSolver batch(4);
+    batch.SetCache(&cache);
+    batch.SetMetrics(&metrics);
+    batch.Solve(sudokus);
+    sudokus = puzzles;
+    batch.Solve(sudokus);
+
+    SudokuMetrics::SudokuMetricsSnapshot snapshot;
+    metrics.Snapshot(snapshot);
+    uint64_t rated = 0;
+    for (size_t tier = 0; tier < SudokuMetrics::UNRATED; ++tier)
+    {
+        rated += snapshot.solves[tier].Count();
+    }
+    SUDOKU_CHECK(rated == data_hard.size() && snapshot.solves[SudokuMetrics::UNRATED].Count() == data_hard.size());
+    SUDOKU_CHECK(snapshot.failures[static_cast<size_t>(SudokuError::Duplicate)] == 2);
+    // the hits never reach the validity check
+    SUDOKU_CHECK(snapshot.validations.Count() == data_hard.size() + 2);
+    SUDOKU_CHECK(snapshot.has_cache && snapshot.cache_hits == data_hard.size() &&
+        snapshot.cache_misses == data_hard.size() + 2);
+
+    std::ostringstream prometheus;
+    metrics.Write(SudokuMetricsFormat::Prometheus, prometheus);
+    SUDOKU_CHECK(prometheus.str().find("sudoku_failures_total{error=\"duplicate\"} 2\n"s) != std::string::npos);
+    SUDOKU_CHECK(prometheus.str().find("sudoku_solve_seconds_count{tier=\"unrated\"} "s +
+        std::to_string(data_hard.size()) + "\n"s) != std::string::npos);
+    std::ostringstream json;
+    metrics.Write(SudokuMetricsFormat::Json, json);
+    SUDOKU_CHECK(json.str().find("\"hit_rate\": "s) != std::string::npos);
+
+    // the exporter leaves a whole snapshot behind when it stops
+    const std::string path = (std::filesystem::temp_directory_path() / "sudoku_test_metrics.prom"s).string();
+    SudokuMetricsExporter exporter(metrics, path, SudokuMetricsFormat::Prometheus, std::chrono::milliseconds(1));
+    exporter.Stop();
+    std::FILE* file = std::fopen(path.c_str(), "r");
+    SUDOKU_CHECK(file != nullptr);
+    char line[64] = {};
+    SUDOKU_CHECK(std::fgets(line, sizeof(line), file) != nullptr && std::string(line).rfind("# HELP "s, 0) == 0);
+    std::fclose(file);
+    std::remove(path.c_str());
+    std::cout << "TestSudokuMetrics Ok"s << std::endl;
+}
+
+void SudokuTest::TestSudokuTrace()
+{
+    const auto count = [](const std::string& text, const std::string& pattern) {
+        size_t res = 0;
+        for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1))
+        {
+            ++res;
+        }
+        return res;
+    };
+
+    // one solve in three on this thread, a pass of singles per pass of the solve
+    SudokuTracer sampled(3);
+    size_t passes = 0;
+    for (size_t i = 0; i < data_hard.size(); ++i)
+    {
+        Sudoku sudoku(data_hard[i].first);
+        SudokuSolver solver(sudoku);
+        solver.SetTracer(&sampled);
+        SudokuResult result;
+        solver.Solve(result);
+        SUDOKU_CHECK(result);
+        if (i % 3 == 0 && !result.solution_steps.empty())
+        {
+            const uint8_t last = result.solution_steps.back().pass;
+            passes += result.Used(SudokuTechnique::Search) ? last - 1 : last;
+        }
+    }
+    std::ostringstream text;
+    sampled.Write(text);
+    const std::string trace = text.str();
+    SUDOKU_CHECK(count(trace, "\"name\": \"solve\""s) == (data_hard.size() + 2) / 3);
+    SUDOKU_CHECK(count(trace, "\"name\": \"validate\""s) == (data_hard.size() + 2) / 3);
+    SUDOKU_CHECK(count(trace, "\"name\": \"singles\""s) == passes);
+    SUDOKU_CHECK(count(trace, "\"ph\": \"M\""s) == 1);
+
+    // every thread of a batch writes a ring of its own, a full ring keeps the last events
+    SudokuTracer small(1, 8);
+    std::vector<Sudoku> sudokus;
+    for (const auto& [input_data, solved_data] : data_extream)
+    {
+        sudokus.emplace_back(input_data);
+    }
+    SudokuBatchSolver batch(2);
+    batch.SetTracer(&small);
+    const std::vector<SudokuResult> results = batch.Solve(sudokus);
+    for (const SudokuResult& result : results)
+    {
+        SUDOKU_CHECK(result);
+    }
+    text.str(""s);
+    small.Write(text);
+    const size_t threads = count(text.str(), "\"ph\": \"M\""s);
+    const size_t events = count(text.str(), "\"ph\": \"X\""s);
+    SUDOKU_CHECK(threads >= 1 && threads <= 2 && events >= 8 && events <= threads * 8);
+
+    const std::string path = (std::filesystem::temp_directory_path() / "sudoku_test_trace.json"s).string();
+    small.Save(path);
+    std::FILE* file = std::fopen(path.c_str(), "r");
+    SUDOKU_CHECK(file != nullptr && std::fgetc(file) == '{');
+    std::fclose(file);
+    std::remove(path.c_str());
+    std::cout << "TestSudokuTrace Ok"s << std::endl;
+}
+
+#ifdef SUDOKU_STATS
+void SudokuTest::TestSudokuStats()
+{
+    // the counters agree with the steps of the same solve
+    SudokuResult result;
+    for (const SudokuTestData* data : { &data_easy, &data_hard, &data_extream })
+    {
+        for (const auto& [input_data, solved_data] : *data)
+        {
+            Sudoku sudoku(input_data);
+            SudokuSolver solver(sudoku);
+            solver.Solve(result);
+            SUDOKU_CHECK(result && sudoku == SudokuGrid(solved_data));
+            const SudokuStats& stats = result.stats;
+            SUDOKU_CHECK(stats.passes == (result.solution_steps.empty() ? 0u : result.solution_steps.back().pass));
+
+            // passes credited to every technique
+            std::array<uint32_t, static_cast<size_t>(SudokuTechnique::Count)> passes = {};
+            uint32_t searched = 0;
+            for (size_t i = 0; i < result.solution_steps.size(); ++i)
+            {
+                const SudokuStep& step = result.solution_steps[i];
+                if (i == 0 || step.pass != result.solution_steps[i - 1].pass)
+                {
+                    ++passes[step.technique];
+                }
+                searched += step.Technique() == SudokuTechnique::Search ? 1 : 0;
+            }
+            for (size_t technique = 0; technique < passes.size(); ++technique)
+            {
+                SUDOKU_CHECK(stats.hits[technique] <= stats.calls[technique]);
+                // an elimination may remove candidates without leaving a single
+                SUDOKU_CHECK(technique < static_cast<size_t>(SudokuTechnique::Pointing) ||
+                        technique == static_cast<size_t>(SudokuTechnique::Search) ?
+                    stats.hits[technique] == passes[technique] :
+                    stats.hits[technique] >= passes[technique]);
+            }
+            SUDOKU_CHECK(stats.search_nodes - stats.search_backtracks == searched);
+            SUDOKU_CHECK(stats.cells_examined > 0 && stats.setup_ns + stats.singles_ns > 0);
+        }
+    }
+
+    // a reused result starts from zero, a cache hit did no solving
+    Sudoku sudoku(data_easy[0].first);
+    SudokuSolutionCache cache(16);
+    cache.Solve(sudoku, result);
+    SUDOKU_CHECK(result && result.stats.search_nodes == 0 && result.stats.calls[0] > 0);
+    Sudoku repeat(data_easy[0].first);
+    cache.Solve(repeat, result);
+    SUDOKU_CHECK(result && result.stats.passes == 0 && result.stats.calls[0] == 0 && result.stats.setup_ns == 0);
+    std::cout << "TestSudokuStats Ok"s << std::endl;
+}
+#endif
+
 void SudokuTest::TestSudokuLocalData(const SudokuTestData& data, const std::string& test_name)
 {
     for (const auto& [input_data, solved_data] : data) {
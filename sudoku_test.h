@@ -11,10 +11,31 @@ public:
 
     static void TestSudoku();
 
+    static const SudokuTestData& DataEasy();
+    static const SudokuTestData& DataMedium();
+    static const SudokuTestData& DataHard();
+    static const SudokuTestData& DataExtream();
+
     static void TestSudokuEasy();
     static void TestSudokuMedium();
     static void TestSudokuHard();
     static void TestSudokuExtream();
+    static void TestSudokuSearch();
+    static void TestSudokuBatch();
+    static void TestSudokuValidity();
+    static void TestSudokuBatchValidity();
+    static void TestSudokuParse();
+    static void TestSudokuBinary();
+    static void TestSudokuCache();
+    static void TestSudokuRating();
+    static void TestSudokuCandidates();
+    static void TestSudokuPopularity();
+    static void TestSudokuSchedule();
+    static void TestSudokuMetrics();
+    static void TestSudokuTrace();
+#ifdef SUDOKU_STATS
+    static void TestSudokuStats();
+#endif
 
 private:
     static void TestSudokuLocalData(const SudokuTestData& data, const std::string& test_name);
@@ -0,0 +1,108 @@
+#include "sudoku_trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+SudokuTraceRing::SudokuTraceRing(std::thread::id thread, size_t capacity,
+    std::chrono::steady_clock::time_point start)
+    : m_thread(thread), m_events(new SudokuTraceEvent[capacity]), m_mask(capacity - 1), m_start(start)
+{
+}
+
+// ----------------------------------------------------------------------------
+
+SudokuTracer::SudokuTracer(size_t sample_every, size_t capacity)
+    : m_sample_every(std::max<size_t>(sample_every, 1)), m_capacity(1), m_start(std::chrono::steady_clock::now())
+{
+    static std::atomic<uint64_t> next_id{ 1 };
+    m_id = next_id.fetch_add(1, std::memory_order_relaxed);
+    while (m_capacity < capacity)
+    {
+        m_capacity <<= 1;
+    }
+}
+
+SudokuTraceRing* SudokuTracer::Sample()
+{
+    SudokuTraceRing* ring = Ring();
+    return ring->m_solves++ % m_sample_every == 0 ? ring : nullptr;
+}
+
+SudokuTraceRing* SudokuTracer::Ring()
+{
+    thread_local uint64_t tracer = 0;
+    thread_local SudokuTraceRing* ring = nullptr;
+    if (tracer == m_id)
+    {
+        return ring;
+    }
+
+    const std::thread::id thread = std::this_thread::get_id();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = std::find_if(m_rings.begin(), m_rings.end(),
+        [thread](const std::unique_ptr<SudokuTraceRing>& candidate) { return candidate->m_thread == thread; });
+    if (found == m_rings.end())
+    {
+        m_rings.push_back(std::make_unique<SudokuTraceRing>(thread, m_capacity, m_start));
+        found = m_rings.end() - 1;
+    }
+    tracer = m_id;
+    ring = found->get();
+    return ring;
+}
+
+void SudokuTracer::Write(std::ostream& out) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    out << "{\n  \"displayTimeUnit\": \"ns\",\n  \"traceEvents\": [\n"s;
+    bool first = true;
+    char number[32];
+    for (size_t tid = 0; tid < m_rings.size(); ++tid)
+    {
+        const SudokuTraceRing& ring = *m_rings[tid];
+        out << (first ? ""s : ",\n"s) << "    { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "s << tid
+            << ", \"args\": { \"name\": \"solver "s << tid << "\" } }"s;
+        first = false;
+        // timestamps are microseconds, kept to the nanosecond
+        const uint64_t oldest = ring.m_next > m_capacity ? ring.m_next - m_capacity : 0;
+        for (uint64_t index = oldest; index < ring.m_next; ++index)
+        {
+            const SudokuTraceEvent& event = ring.m_events[index & ring.m_mask];
+            std::snprintf(number, sizeof(number), "%.3f", static_cast<double>(event.begin) / 1000.0);
+            out << ",\n    { \"name\": \""s << event.name << "\", \"cat\": \"sudoku\", \"ph\": \"X\", \"ts\": "s
+                << number;
+            std::snprintf(number, sizeof(number), "%.3f", static_cast<double>(event.end - event.begin) / 1000.0);
+            out << ", \"dur\": "s << number << ", \"pid\": 1, \"tid\": "s << tid;
+            if (event.pass != 0)
+            {
+                out << ", \"args\": { \"pass\": "s << event.pass << " }"s;
+            }
+            out << " }"s;
+        }
+    }
+    out << "\n  ]\n}\n"s;
+}
+
+void SudokuTracer::Save(const std::string& path) const
+{
+    std::ostringstream text;
+    Write(text);
+    const std::string trace = text.str();
+
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (file == nullptr)
+    {
+        throw std::invalid_argument("Can't open file "s + path);
+    }
+    bool written = std::fwrite(trace.data(), 1, trace.size(), file) == trace.size();
+    written = std::fclose(file) == 0 && written;
+    if (!written)
+    {
+        throw std::runtime_error("Can't write trace file "s + path);
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef SUDOKU_TRACE_H
+#define SUDOKU_TRACE_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One timed span, names are string literals
+struct SudokuTraceEvent
+{
+    const char* name;
+    // nanoseconds since the tracer started
+    uint64_t begin;
+    uint64_t end;
+    // solver pass, 0 for none
+    uint32_t pass;
+};
+
+// Events of one thread. Only the thread writes them, the oldest are
+// overwritten once the ring is full.
+class SudokuTraceRing
+{
+public:
+    SudokuTraceRing(std::thread::id thread, size_t capacity, std::chrono::steady_clock::time_point start);
+
+    uint64_t Now() const
+    {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start)
+                .count());
+    }
+
+    void Add(const char* name, uint64_t begin, uint64_t end, uint32_t pass)
+    {
+        m_events[m_next & m_mask] = { name, begin, end, pass };
+        ++m_next;
+    }
+
+private:
+    friend class SudokuTracer;
+
+    std::thread::id m_thread;
+    std::unique_ptr<SudokuTraceEvent[]> m_events;
+    size_t m_mask;
+    // events written so far, the ring holds the last capacity of them
+    uint64_t m_next = 0;
+    // solves seen, for the sampling
+    uint64_t m_solves = 0;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// Traces one solve in every sample_every per thread into rings of the
+// threads, written out as Chrome trace event JSON for chrome://tracing or
+// Perfetto. A solve that isn't sampled costs a thread local lookup and a
+// branch per span. Write and Save read the rings without a lock, they must
+// not run while a solve is traced.
+class SudokuTracer
+{
+public:
+    // capacity is rounded up to a power of two
+    explicit SudokuTracer(size_t sample_every = 1, size_t capacity = 1 << 16);
+
+    SudokuTracer(const SudokuTracer&) = delete;
+    SudokuTracer& operator=(const SudokuTracer&) = delete;
+
+    // Ring of the calling thread when its next solve is to be traced, else nullptr
+    SudokuTraceRing* Sample();
+
+    void Write(std::ostream& out) const;
+    // throws std::invalid_argument when the file can't be opened and
+    // std::runtime_error when it can't be written
+    void Save(const std::string& path) const;
+
+private:
+    SudokuTraceRing* Ring();
+
+private:
+    // tells apart the tracers a thread has seen, the ring of the last one is kept at hand
+    uint64_t m_id;
+    size_t m_sample_every;
+    size_t m_capacity;
+    std::chrono::steady_clock::time_point m_start;
+
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<SudokuTraceRing>> m_rings;
+};
+
+// Records the span from its construction to its destruction, nothing when
+// the ring is nullptr
+class SudokuTraceScope
+{
+public:
+    SudokuTraceScope(SudokuTraceRing* ring, const char* name, uint32_t pass = 0)
+        : m_ring(ring), m_name(name), m_pass(pass), m_begin(ring != nullptr ? ring->Now() : 0)
+    {
+    }
+
+    ~SudokuTraceScope()
+    {
+        if (m_ring != nullptr)
+        {
+            m_ring->Add(m_name, m_begin, m_ring->Now(), m_pass);
+        }
+    }
+
+    SudokuTraceScope(const SudokuTraceScope&) = delete;
+    SudokuTraceScope& operator=(const SudokuTraceScope&) = delete;
+
+private:
+    SudokuTraceRing* m_ring;
+    const char* m_name;
+    uint32_t m_pass;
+    uint64_t m_begin;
+};
+
+#endif // SUDOKU_TRACE_H
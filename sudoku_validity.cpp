@@ -0,0 +1,259 @@
+#include "sudoku_validity.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SUDOKU_HAS_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+constexpr const SudokuUnits& UNITS = SudokuGrid::Units();
+
+#ifdef SUDOKU_HAS_X86_SIMD
+// lanes[cell][grid]: the same cell of every grid of the group side by side
+void Transpose(const uint8_t* grids, size_t stride, size_t count, uint8_t (*lanes)[16])
+{
+    for (size_t grid = 0; grid < count; ++grid)
+    {
+        const uint8_t* cells = grids + grid * stride;
+        for (int cell = 0; cell < 81; ++cell)
+        {
+            lanes[cell][grid] = cells[cell];
+        }
+    }
+}
+
+SudokuGridStatus LaneStatus(uint8_t max_value, uint8_t empty, uint16_t duplicates)
+{
+    if (max_value > 9)
+    {
+        return SudokuGridStatus::BadValue;
+    }
+    if (duplicates != 0)
+    {
+        return SudokuGridStatus::Duplicate;
+    }
+    return empty != 0 ? SudokuGridStatus::Incomplete : SudokuGridStatus::Complete;
+}
+
+// 1 << value split into its low and high byte, values above 9 map to 0
+// and are caught by the maximum
+__attribute__((target("ssse3"))) __m128i LowBitTable()
+{
+    return _mm_setr_epi8(0, 2, 4, 8, 16, 32, 64, static_cast<char>(128), 0, 0, 0, 0, 0, 0, 0, 0);
+}
+
+__attribute__((target("ssse3"))) __m128i HighBitTable()
+{
+    return _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 0, 0, 0, 0, 0, 0);
+}
+
+// 8 grids, one 16-bit lane per grid
+__attribute__((target("ssse3"))) void ValidateSsse3(const uint8_t* grids, size_t stride,
+    SudokuGridStatus* statuses)
+{
+    alignas(16) uint8_t lanes[81][16];
+    Transpose(grids, stride, 8, lanes);
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i low_table = LowBitTable();
+    const __m128i high_table = HighBitTable();
+    __m128i bits[81];
+    __m128i max_value = zero;
+    __m128i empty = zero;
+    for (int cell = 0; cell < 81; ++cell)
+    {
+        const __m128i values = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(lanes[cell]));
+        max_value = _mm_max_epu8(max_value, values);
+        empty = _mm_or_si128(empty, _mm_cmpeq_epi8(values, zero));
+        bits[cell] = _mm_unpacklo_epi8(_mm_shuffle_epi8(low_table, values), _mm_shuffle_epi8(high_table, values));
+    }
+
+    __m128i duplicates = zero;
+    for (const auto& unit : UNITS.cells)
+    {
+        __m128i seen = zero;
+        for (uint8_t cell : unit)
+        {
+            duplicates = _mm_or_si128(duplicates, _mm_and_si128(seen, bits[cell]));
+            seen = _mm_or_si128(seen, bits[cell]);
+        }
+    }
+
+    alignas(16) uint8_t max_lanes[16];
+    alignas(16) uint8_t empty_lanes[16];
+    alignas(16) uint16_t duplicate_lanes[8];
+    _mm_store_si128(reinterpret_cast<__m128i*>(max_lanes), max_value);
+    _mm_store_si128(reinterpret_cast<__m128i*>(empty_lanes), empty);
+    _mm_store_si128(reinterpret_cast<__m128i*>(duplicate_lanes), duplicates);
+    for (int grid = 0; grid < 8; ++grid)
+    {
+        statuses[grid] = LaneStatus(max_lanes[grid], empty_lanes[grid], duplicate_lanes[grid]);
+    }
+}
+
+// 16 grids, one 16-bit lane per grid
+__attribute__((target("avx2"))) void ValidateAvx2(const uint8_t* grids, size_t stride,
+    SudokuGridStatus* statuses)
+{
+    alignas(32) uint8_t lanes[81][16];
+    Transpose(grids, stride, 16, lanes);
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i low_table = LowBitTable();
+    const __m128i high_table = HighBitTable();
+    __m256i bits[81];
+    __m128i max_value = zero;
+    __m128i empty = zero;
+    for (int cell = 0; cell < 81; ++cell)
+    {
+        const __m128i values = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes[cell]));
+        max_value = _mm_max_epu8(max_value, values);
+        empty = _mm_or_si128(empty, _mm_cmpeq_epi8(values, zero));
+        const __m128i low = _mm_shuffle_epi8(low_table, values);
+        const __m128i high = _mm_shuffle_epi8(high_table, values);
+        bits[cell] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi8(low, high)),
+            _mm_unpackhi_epi8(low, high), 1);
+    }
+
+    __m256i duplicates = _mm256_setzero_si256();
+    for (const auto& unit : UNITS.cells)
+    {
+        __m256i seen = _mm256_setzero_si256();
+        for (uint8_t cell : unit)
+        {
+            duplicates = _mm256_or_si256(duplicates, _mm256_and_si256(seen, bits[cell]));
+            seen = _mm256_or_si256(seen, bits[cell]);
+        }
+    }
+
+    alignas(16) uint8_t max_lanes[16];
+    alignas(16) uint8_t empty_lanes[16];
+    alignas(32) uint16_t duplicate_lanes[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(max_lanes), max_value);
+    _mm_store_si128(reinterpret_cast<__m128i*>(empty_lanes), empty);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(duplicate_lanes), duplicates);
+    for (int grid = 0; grid < 16; ++grid)
+    {
+        statuses[grid] = LaneStatus(max_lanes[grid], empty_lanes[grid], duplicate_lanes[grid]);
+    }
+}
+#endif
+}
+
+const char* IsaName(SudokuIsa isa)
+{
+    switch (isa)
+    {
+    case SudokuIsa::Avx2:
+        return "avx2";
+    case SudokuIsa::Ssse3:
+        return "ssse3";
+    default:
+        return "scalar";
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+SudokuIsa SudokuBatchValidity::DetectIsa()
+{
+#ifdef SUDOKU_HAS_X86_SIMD
+    static const SudokuIsa isa = []() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return SudokuIsa::Avx2;
+        }
+        if (__builtin_cpu_supports("ssse3"))
+        {
+            return SudokuIsa::Ssse3;
+        }
+        return SudokuIsa::Scalar;
+    }();
+    return isa;
+#else
+    return SudokuIsa::Scalar;
+#endif
+}
+
+void SudokuBatchValidity::Validate(const uint8_t* grids, size_t stride, size_t count, SudokuGridStatus* statuses,
+    SudokuIsa isa)
+{
+    if (isa > DetectIsa())
+    {
+        isa = DetectIsa();
+    }
+    size_t index = 0;
+#ifdef SUDOKU_HAS_X86_SIMD
+    if (isa == SudokuIsa::Avx2)
+    {
+        for (; index + 16 <= count; index += 16)
+        {
+            ValidateAvx2(grids + index * stride, stride, statuses + index);
+        }
+    }
+    if (isa >= SudokuIsa::Ssse3)
+    {
+        for (; index + 8 <= count; index += 8)
+        {
+            ValidateSsse3(grids + index * stride, stride, statuses + index);
+        }
+    }
+#endif
+    for (; index < count; ++index)
+    {
+        statuses[index] = ValidateScalar(grids + index * stride);
+    }
+}
+
+void SudokuBatchValidity::Validate(const SudokuGrid* grids, size_t count, SudokuGridStatus* statuses)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    Validate(grids->Values().data(), sizeof(SudokuGrid), count, statuses);
+}
+
+SudokuValid SudokuBatchValidity::Explain(const uint8_t* grid)
+{
+    SudokuGrid filled;
+    const SudokuValid valid = filled.TryFillGrid(grid, 81);
+    return valid ? SudokuCheckValidity::IsSudokuValid(filled) : valid;
+}
+
+SudokuGridStatus SudokuBatchValidity::ValidateScalar(const uint8_t* grid)
+{
+    uint16_t rows[9] = {};
+    uint16_t cols[9] = {};
+    uint16_t squares[9] = {};
+    uint16_t duplicates = 0;
+    bool empty = false;
+    for (int cell = 0; cell < 81; ++cell)
+    {
+        const int value = grid[cell];
+        if (value > 9)
+        {
+            return SudokuGridStatus::BadValue;
+        }
+        if (value == 0)
+        {
+            empty = true;
+            continue;
+        }
+        const int row = cell / 9;
+        const int col = cell % 9;
+        const int square = row / 3 * 3 + col / 3;
+        const uint16_t bit = static_cast<uint16_t>(1u << value);
+        duplicates |= (rows[row] | cols[col] | squares[square]) & bit;
+        rows[row] |= bit;
+        cols[col] |= bit;
+        squares[square] |= bit;
+    }
+    if (duplicates != 0)
+    {
+        return SudokuGridStatus::Duplicate;
+    }
+    return empty ? SudokuGridStatus::Incomplete : SudokuGridStatus::Complete;
+}
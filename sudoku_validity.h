@@ -0,0 +1,53 @@
+#ifndef SUDOKU_VALIDITY_H
+#define SUDOKU_VALIDITY_H
+
+#include "sudoku.h"
+
+#include <cstddef>
+#include <cstdint>
+
+enum class SudokuGridStatus : uint8_t
+{
+    // every cell filled, no repeated number
+    Complete,
+    // some cells empty, no repeated number
+    Incomplete,
+    // a number appears twice in a row, col or square
+    Duplicate,
+    // a cell holds something other than 0..9
+    BadValue
+};
+
+enum class SudokuIsa
+{
+    Scalar,
+    Ssse3,
+    Avx2
+};
+
+const char* IsaName(SudokuIsa isa);
+
+// Checks many grids per call without solving them.
+// Grids are records of 81 cell bytes (0 for an empty cell) placed `stride`
+// bytes apart in one buffer, so an array of SudokuGrid (stride 81) can be
+// passed as it is; Sudoku objects are copied into one first. The SIMD paths
+// check 8 (SSSE3) or 16 (AVX2) grids at once, the instruction set is picked
+// at runtime.
+class SudokuBatchValidity
+{
+public:
+    static SudokuIsa DetectIsa();
+
+    // isa is lowered to what the CPU supports
+    static void Validate(const uint8_t* grids, size_t stride, size_t count, SudokuGridStatus* statuses,
+        SudokuIsa isa = DetectIsa());
+    static void Validate(const SudokuGrid* grids, size_t count, SudokuGridStatus* statuses);
+
+    // First error of one grid, SudokuValid::Text() describes it
+    static SudokuValid Explain(const uint8_t* grid);
+
+private:
+    static SudokuGridStatus ValidateScalar(const uint8_t* grid);
+};
+
+#endif // SUDOKU_VALIDITY_H